@@ -73,13 +73,13 @@ public:
     }
 
     //! Calculate in which "tried" bucket this entry belongs
-    int GetTriedBucket(const uint256 &nKey, const std::vector<bool> &asmap) const;
+    int GetTriedBucket(const uint256 &nKey, const Asmap &asmap) const;
 
     //! Calculate in which "new" bucket this entry belongs, given a certain source
-    int GetNewBucket(const uint256 &nKey, const CNetAddr& src, const std::vector<bool> &asmap) const;
+    int GetNewBucket(const uint256 &nKey, const CNetAddr& src, const Asmap &asmap) const;
 
     //! Calculate in which "new" bucket this entry belongs, using its default source
-    int GetNewBucket(const uint256 &nKey, const std::vector<bool> &asmap) const
+    int GetNewBucket(const uint256 &nKey, const Asmap &asmap) const
     {
         return GetNewBucket(nKey, source, asmap);
     }
@@ -284,7 +284,10 @@ public:
     //
     // If a new asmap was provided, the existing records
     // would be re-bucketed accordingly.
-    std::vector<bool> m_asmap;
+    //
+    // It is decoded into a lookup table once when set, as the
+    // bucketing of every address we process looks it up.
+    Asmap m_asmap;
 
     // Read asmap from provided binary file
     static std::vector<bool> DecodeAsmap(fs::path path);
@@ -370,8 +373,8 @@ public:
         // Store asmap version after bucket entries so that it
         // can be ignored by older clients for backward compatibility.
         uint256 asmap_version;
-        if (m_asmap.size() != 0) {
-            asmap_version = SerializeHash(m_asmap);
+        if (!m_asmap.IsEmpty()) {
+            asmap_version = SerializeHash(m_asmap.GetBits());
         }
         s << asmap_version;
     }
@@ -451,8 +454,8 @@ public:
         }
 
         uint256 supplied_asmap_version;
-        if (m_asmap.size() != 0) {
-            supplied_asmap_version = SerializeHash(m_asmap);
+        if (!m_asmap.IsEmpty()) {
+            supplied_asmap_version = SerializeHash(m_asmap.GetBits());
         }
         uint256 serialized_asmap_version;
         if (nVersion > 1) {
@@ -62,6 +62,7 @@ void BanMan::ClearBanned()
     {
         LOCK(m_cs_banned);
         m_banned.clear();
+        m_banned_trie.Clear();
         m_is_dirty = true;
     }
     DumpBanlist(); //store banlist to disk
@@ -78,15 +79,9 @@ bool BanMan::IsBanned(const CNetAddr& net_addr)
 {
     auto current_time = GetTime();
     LOCK(m_cs_banned);
-    for (const auto& it : m_banned) {
-        CSubNet sub_net = it.first;
-        CBanEntry ban_entry = it.second;
-
-        if (current_time < ban_entry.nBanUntil && sub_net.Match(net_addr)) {
-            return true;
-        }
-    }
-    return false;
+    return m_banned_trie.ForEachMatch(net_addr, [&](int64_t ban_until) {
+        return current_time < ban_until;
+    });
 }
 
 bool BanMan::IsBanned(const CSubNet& sub_net)
@@ -131,6 +126,7 @@ void BanMan::Ban(const CSubNet& sub_net, int64_t ban_time_offset, bool since_uni
         LOCK(m_cs_banned);
         if (m_banned[sub_net].nBanUntil < ban_entry.nBanUntil) {
             m_banned[sub_net] = ban_entry;
+            m_banned_trie[sub_net] = ban_entry.nBanUntil;
             m_is_dirty = true;
         } else
             return;
@@ -152,6 +148,7 @@ bool BanMan::Unban(const CSubNet& sub_net)
     {
         LOCK(m_cs_banned);
         if (m_banned.erase(sub_net) == 0) return false;
+        m_banned_trie.Erase(sub_net);
         m_is_dirty = true;
     }
     if (m_client_interface) m_client_interface->BannedListChanged();
@@ -171,6 +168,10 @@ void BanMan::SetBanned(const banmap_t& banmap)
 {
     LOCK(m_cs_banned);
     m_banned = banmap;
+    m_banned_trie.Clear();
+    for (const auto& entry : m_banned) {
+        m_banned_trie[entry.first] = entry.second.nBanUntil;
+    }
     m_is_dirty = true;
 }
 
@@ -186,6 +187,7 @@ void BanMan::SweepBanned()
             CBanEntry ban_entry = (*it).second;
             if (now > ban_entry.nBanUntil) {
                 m_banned.erase(it++);
+                m_banned_trie.Erase(sub_net);
                 m_is_dirty = true;
                 notify_ui = true;
                 LogPrint(BCLog::NET, "%s: Removed banned node ip/subnet from banlist.dat: %s\n", __func__, sub_net.ToString());
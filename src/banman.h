@@ -9,6 +9,7 @@
 #include <bloom.h>
 #include <fs.h>
 #include <net_types.h> // For banmap_t
+#include <subnettrie.h>
 #include <sync.h>
 
 #include <chrono>
@@ -88,6 +89,8 @@ private:
 
     RecursiveMutex m_cs_banned;
     banmap_t m_banned GUARDED_BY(m_cs_banned);
+    //! The nBanUntil of each entry of m_banned, for matching addresses against them
+    SubNetTrie<int64_t> m_banned_trie GUARDED_BY(m_cs_banned);
     bool m_is_dirty GUARDED_BY(m_cs_banned);
     CClientUIInterface* m_client_interface = nullptr;
     CBanDB m_ban_db;
@@ -0,0 +1,189 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <crypto/common.h>
+#include <random.h>
+#include <util/asmap.h>
+
+#include <cassert>
+#include <memory>
+#include <vector>
+
+namespace {
+
+/** A prefix trie of ASNs, encoded into the bytecode Interpret() runs. */
+struct PrefixNode {
+    std::unique_ptr<PrefixNode> child[2];
+    uint32_t asn{0};
+};
+
+void EncodeBits(std::vector<bool>& out, uint32_t val, uint32_t minval, const std::vector<uint8_t>& bit_sizes)
+{
+    val -= minval;
+    for (size_t i = 0; i < bit_sizes.size(); ++i) {
+        const uint32_t range = uint32_t{1} << bit_sizes[i];
+        if (i + 1 != bit_sizes.size()) {
+            if (val >= range) {
+                out.push_back(true);
+                val -= range;
+                continue;
+            }
+            out.push_back(false);
+        }
+        for (int b = bit_sizes[i] - 1; b >= 0; --b) out.push_back((val >> b) & 1);
+        return;
+    }
+}
+
+void EncodeNode(std::vector<bool>& out, const PrefixNode& node)
+{
+    if (node.asn != 0) {
+        out.push_back(false); // RETURN
+        EncodeBits(out, node.asn, 1, {15, 16, 17, 18, 19, 20, 21, 22, 23, 24});
+    } else if (node.child[0] && node.child[1]) {
+        std::vector<bool> zero;
+        EncodeNode(zero, *node.child[0]);
+        out.push_back(true); // JUMP
+        out.push_back(false);
+        EncodeBits(out, zero.size(), 17, {5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30});
+        out.insert(out.end(), zero.begin(), zero.end());
+        EncodeNode(out, *node.child[1]);
+    } else {
+        // Match up to 8 bits of a chain of single child nodes at once;
+        // addresses that do not match are unmapped.
+        const PrefixNode* cur = &node;
+        uint32_t match = 1;
+        for (int len = 0; len < 8 && cur->asn == 0 && !(cur->child[0] && cur->child[1]); ++len) {
+            const int bit = cur->child[1] ? 1 : 0;
+            match = (match << 1) | bit;
+            cur = cur->child[bit].get();
+        }
+        out.push_back(true); // MATCH
+        out.push_back(true);
+        out.push_back(false);
+        EncodeBits(out, match, 2, {1, 2, 3, 4, 5, 6, 7, 8});
+        EncodeNode(out, *cur);
+    }
+}
+
+void AddPrefix(PrefixNode& root, const unsigned char (&prefix)[16], int len, uint32_t asn)
+{
+    PrefixNode* node = &root;
+    for (int i = 0; i < len; ++i) {
+        if (node->asn != 0) return; // covered by a shorter prefix
+        const int bit = (prefix[i / 8] >> (7 - i % 8)) & 1;
+        if (!node->child[bit]) node->child[bit].reset(new PrefixNode());
+        node = node->child[bit].get();
+    }
+    if (!node->child[0] && !node->child[1]) node->asn = asn;
+}
+
+/** An asmap the size of a real one: IPv4 prefixes of /12 to /24, and IPv6 prefixes of /24 to /48. */
+std::vector<bool> MakeAsmap(FastRandomContext& rng)
+{
+    PrefixNode root;
+    unsigned char prefix[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+    for (int i = 0; i < 100000; ++i) {
+        WriteLE32(prefix + 12, rng.rand32());
+        AddPrefix(root, prefix, 96 + 12 + rng.randrange(13), 1 + rng.randrange(60000));
+    }
+    unsigned char prefix6[16] = {0x20};
+    for (int i = 0; i < 20000; ++i) {
+        WriteLE32(prefix6 + 1, rng.rand32());
+        WriteLE32(prefix6 + 4, rng.rand32());
+        prefix6[0] = 0x20 | rng.randbits(1);
+        AddPrefix(root, prefix6, 24 + rng.randrange(25), 1 + rng.randrange(60000));
+    }
+    std::vector<bool> bits;
+    EncodeNode(bits, root);
+    return bits;
+}
+
+struct BenchAddr {
+    unsigned char ip[16];
+};
+
+struct AsmapBenchData {
+    std::vector<bool> bits;
+    Asmap asmap;
+    std::vector<BenchAddr> addrs;
+
+    AsmapBenchData()
+    {
+        FastRandomContext rng(true);
+        bits = MakeAsmap(rng);
+        asmap = Asmap(bits);
+        for (int i = 0; i < 1000; ++i) {
+            BenchAddr addr{};
+            if (i % 4) {
+                addr.ip[10] = addr.ip[11] = 0xff;
+                WriteLE32(addr.ip + 12, rng.rand32());
+            } else {
+                addr.ip[0] = 0x20 | rng.randbits(1);
+                for (int j = 1; j < 16; ++j) addr.ip[j] = rng.randbits(8);
+            }
+            addrs.push_back(addr);
+        }
+    }
+};
+
+const AsmapBenchData& GetAsmapBenchData()
+{
+    static const AsmapBenchData data;
+    return data;
+}
+
+std::vector<bool> ToBits(const BenchAddr& addr)
+{
+    std::vector<bool> ip_bits(128);
+    for (int i = 0; i < 128; ++i) {
+        ip_bits[i] = (addr.ip[i / 8] >> (7 - i % 8)) & 1;
+    }
+    return ip_bits;
+}
+
+} // namespace
+
+static void AsmapInterpret(benchmark::State& state)
+{
+    const AsmapBenchData& data = GetAsmapBenchData();
+    std::vector<std::vector<bool>> ips;
+    for (const auto& addr : data.addrs) ips.push_back(ToBits(addr));
+    uint64_t sum = 0;
+    while (state.KeepRunning()) {
+        for (const auto& ip : ips) {
+            sum += Interpret(data.bits, ip);
+        }
+    }
+    assert(sum != 0);
+}
+
+static void AsmapLookup(benchmark::State& state)
+{
+    const AsmapBenchData& data = GetAsmapBenchData();
+    for (const auto& addr : data.addrs) {
+        assert(data.asmap.Lookup(addr.ip) == Interpret(data.bits, ToBits(addr)));
+    }
+    uint64_t sum = 0;
+    while (state.KeepRunning()) {
+        for (const auto& addr : data.addrs) {
+            sum += data.asmap.Lookup(addr.ip);
+        }
+    }
+    assert(sum != 0);
+}
+
+static void AsmapDecode(benchmark::State& state)
+{
+    const AsmapBenchData& data = GetAsmapBenchData();
+    while (state.KeepRunning()) {
+        Asmap asmap(data.bits);
+        assert(asmap.Size() > 0);
+    }
+}
+
+BENCHMARK(AsmapInterpret, 20);
+BENCHMARK(AsmapLookup, 2000);
+BENCHMARK(AsmapDecode, 1);
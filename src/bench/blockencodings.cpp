@@ -0,0 +1,79 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <blockencodings.h>
+#include <random.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <vector>
+
+static void AddTx(const CTransactionRef& tx, CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
+{
+    LockPoints lp;
+    pool.addUnchecked(CTxMemPoolEntry(tx, 1000, 0, 1, false, 4, lp));
+}
+
+static CTransactionRef MakeTx(FastRandomContext& rand)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(rand.rand256(), 0);
+    tx.vin[0].scriptWitness.stack.push_back(std::vector<unsigned char>(72, 1));
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[0].nValue = COIN;
+    return MakeTransactionRef(tx);
+}
+
+// Reconstruction of a block of 2000 transactions announced as a compact block,
+// of which all but a few are found in the mempool. The time it takes grows with
+// the size of the mempool, as every mempool transaction gets a short ID.
+static void CompactBlockReconstruction(benchmark::State& state, size_t mempool_size)
+{
+    static const size_t BLOCK_TXS = 2000;
+    static const size_t MISSING_TXS = 10;
+    FastRandomContext rand{true};
+    CTxMemPool pool;
+    CBlock block;
+    // A null header (nBits == 0) is rejected before any reconstruction
+    block.nBits = 0x207fffff;
+    {
+        LOCK2(cs_main, pool.cs);
+        block.vtx.push_back(MakeTx(rand));
+        for (size_t i = 0; i < mempool_size; ++i) {
+            CTransactionRef tx = MakeTx(rand);
+            AddTx(tx, pool);
+            if (i % (mempool_size / BLOCK_TXS) == 0 && block.vtx.size() <= BLOCK_TXS - MISSING_TXS) {
+                block.vtx.push_back(tx);
+            }
+        }
+        while (block.vtx.size() <= BLOCK_TXS) {
+            block.vtx.push_back(MakeTx(rand));
+        }
+    }
+    const CBlockHeaderAndShortTxIDs cmpctblock(block, true);
+    const std::vector<std::pair<uint256, CTransactionRef>> extra_txn;
+
+    while (state.KeepRunning()) {
+        PartiallyDownloadedBlock partial_block(&pool);
+        bool ok = partial_block.InitData(cmpctblock, extra_txn) == READ_STATUS_OK;
+        assert(ok);
+        assert(!partial_block.IsTxAvailable(BLOCK_TXS));
+    }
+}
+
+static void CompactBlockReconstruction5k(benchmark::State& state)
+{
+    CompactBlockReconstruction(state, 5000);
+}
+
+static void CompactBlockReconstruction50k(benchmark::State& state)
+{
+    CompactBlockReconstruction(state, 50000);
+}
+
+BENCHMARK(CompactBlockReconstruction5k, 2000);
+BENCHMARK(CompactBlockReconstruction50k, 200);
@@ -6,6 +6,7 @@
 #include <bench/data.h>
 
 #include <chainparams.h>
+#include <primitives/block_view.h>
 #include <validation.h>
 #include <streams.h>
 #include <consensus/validation.h>
@@ -28,6 +29,16 @@ static void DeserializeBlockTest(benchmark::State& state)
     }
 }
 
+static void ParseBlockViewTest(benchmark::State& state)
+{
+    const Span<const uint8_t> data = MakeSpan(benchmark::data::block413567);
+
+    while (state.KeepRunning()) {
+        BlockView block(data);
+        assert(!block.Transactions().empty());
+    }
+}
+
 static void DeserializeAndCheckBlockTest(benchmark::State& state)
 {
     CDataStream stream(benchmark::data::block413567, SER_NETWORK, PROTOCOL_VERSION);
@@ -49,4 +60,5 @@ static void DeserializeAndCheckBlockTest(benchmark::State& state)
 }
 
 BENCHMARK(DeserializeBlockTest, 130);
+BENCHMARK(ParseBlockViewTest, 130);
 BENCHMARK(DeserializeAndCheckBlockTest, 160);
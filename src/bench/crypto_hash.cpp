@@ -58,6 +58,38 @@ static void SHA256D64_1024(benchmark::State& state)
     }
 }
 
+static void SHA256DMulti_1024(benchmark::State& state)
+{
+    // Messages of typical transaction sizes.
+    std::vector<std::vector<uint8_t>> in(1024);
+    std::vector<const unsigned char*> inputs;
+    std::vector<size_t> lengths;
+    for (size_t i = 0; i < in.size(); ++i) {
+        in[i].resize(200 + (i * 37) % 400);
+        inputs.push_back(in[i].data());
+        lengths.push_back(in[i].size());
+    }
+    std::vector<uint8_t> out(32 * in.size());
+    while (state.KeepRunning()) {
+        SHA256DMulti(out.data(), inputs.data(), lengths.data(), in.size());
+    }
+}
+
+static void SHA256D_1024(benchmark::State& state)
+{
+    // The same messages as SHA256DMulti_1024, hashed one at a time.
+    std::vector<std::vector<uint8_t>> in(1024);
+    for (size_t i = 0; i < in.size(); ++i) {
+        in[i].resize(200 + (i * 37) % 400);
+    }
+    std::vector<uint8_t> out(32 * in.size());
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < in.size(); ++i) {
+            CHash256().Write(in[i].data(), in[i].size()).Finalize(out.data() + 32 * i);
+        }
+    }
+}
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -99,5 +131,7 @@ BENCHMARK(SHA512, 330);
 BENCHMARK(SHA256_32b, 4700 * 1000);
 BENCHMARK(SipHash_32b, 40 * 1000 * 1000);
 BENCHMARK(SHA256D64_1024, 7400);
+BENCHMARK(SHA256DMulti_1024, 100);
+BENCHMARK(SHA256D_1024, 100);
 BENCHMARK(FastRandom_32bit, 110 * 1000 * 1000);
 BENCHMARK(FastRandom_1bit, 440 * 1000 * 1000);
@@ -11,6 +11,7 @@
 #include <script/standard.h>
 #include <streams.h>
 #include <test/util/transaction_utils.h>
+#include <ticket.h>
 
 #include <array>
 
@@ -71,6 +72,97 @@ static void VerifyScriptBench(benchmark::State& state)
     }
 }
 
+static CKey BenchKey()
+{
+    CKey key;
+    static const std::array<unsigned char, 32> vchKey = {
+        {
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1
+        }
+    };
+    key.Set(vchKey.begin(), vchKey.end(), true);
+    return key;
+}
+
+// Microbenchmark for verification of a P2PKH spend, which VerifyScript handles
+// without running the interpreter.
+static void VerifyScriptP2PKHBench(benchmark::State& state)
+{
+    const int flags = SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC | SCRIPT_VERIFY_MINIMALDATA;
+    const CKey key = BenchKey();
+    const CPubKey pubkey = key.GetPubKey();
+
+    const CScript scriptPubKey = GetScriptForDestination(PKHash(pubkey));
+    const CMutableTransaction& txCredit = BuildCreditingTransaction(scriptPubKey, 1);
+    CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), CScriptWitness(), CTransaction(txCredit));
+    std::vector<unsigned char> vchSig;
+    key.Sign(SignatureHash(scriptPubKey, txSpend, 0, SIGHASH_ALL, txCredit.vout[0].nValue, SigVersion::BASE), vchSig);
+    vchSig.push_back(static_cast<unsigned char>(SIGHASH_ALL));
+    txSpend.vin[0].scriptSig = CScript() << vchSig << ToByteVector(pubkey);
+
+    const MutableTransactionSignatureChecker checker(&txSpend, 0, txCredit.vout[0].nValue);
+    while (state.KeepRunning()) {
+        ScriptError err;
+        bool success = VerifyScript(txSpend.vin[0].scriptSig, scriptPubKey, &txSpend.vin[0].scriptWitness, flags, checker, &err);
+        assert(err == SCRIPT_ERR_OK);
+        assert(success);
+    }
+}
+
+// The same P2PKH spend evaluated by the generic interpreter, as VerifyScript
+// did before it learned the standard templates.
+static void VerifyScriptP2PKHInterpreterBench(benchmark::State& state)
+{
+    const int flags = SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC | SCRIPT_VERIFY_MINIMALDATA;
+    const CKey key = BenchKey();
+    const CPubKey pubkey = key.GetPubKey();
+
+    const CScript scriptPubKey = GetScriptForDestination(PKHash(pubkey));
+    const CMutableTransaction& txCredit = BuildCreditingTransaction(scriptPubKey, 1);
+    CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), CScriptWitness(), CTransaction(txCredit));
+    std::vector<unsigned char> vchSig;
+    key.Sign(SignatureHash(scriptPubKey, txSpend, 0, SIGHASH_ALL, txCredit.vout[0].nValue, SigVersion::BASE), vchSig);
+    vchSig.push_back(static_cast<unsigned char>(SIGHASH_ALL));
+    txSpend.vin[0].scriptSig = CScript() << vchSig << ToByteVector(pubkey);
+
+    const MutableTransactionSignatureChecker checker(&txSpend, 0, txCredit.vout[0].nValue);
+    while (state.KeepRunning()) {
+        std::vector<std::vector<unsigned char>> stack, stackCopy;
+        bool success = EvalScript(stack, txSpend.vin[0].scriptSig, flags, checker, SigVersion::BASE, nullptr);
+        stackCopy = stack;
+        success = success && EvalScript(stack, scriptPubKey, flags, checker, SigVersion::BASE, nullptr);
+        assert(success && stack.size() == 1 && !stack.back().empty());
+    }
+}
+
+// Microbenchmark for verification of a P2SH spend of a ticket redeem script.
+static void VerifyScriptTicketBench(benchmark::State& state)
+{
+    const int flags = SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY | SCRIPT_VERIFY_STRICTENC | SCRIPT_VERIFY_MINIMALDATA;
+    const int lockHeight = 2047;
+    const CKey key = BenchKey();
+    const CPubKey pubkey = key.GetPubKey();
+
+    const CScript redeemScript = GenerateTicketScript(pubkey.GetID(), lockHeight);
+    const CScript scriptPubKey = GetScriptForDestination(ScriptHash(redeemScript));
+    const CMutableTransaction& txCredit = BuildCreditingTransaction(scriptPubKey, 1);
+    CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), CScriptWitness(), CTransaction(txCredit));
+    txSpend.nLockTime = lockHeight;
+    txSpend.vin[0].nSequence = CTxIn::SEQUENCE_FINAL - 1;
+    std::vector<unsigned char> vchSig;
+    key.Sign(SignatureHash(redeemScript, txSpend, 0, SIGHASH_ALL, txCredit.vout[0].nValue, SigVersion::BASE), vchSig);
+    vchSig.push_back(static_cast<unsigned char>(SIGHASH_ALL));
+    txSpend.vin[0].scriptSig = CScript() << vchSig << ToByteVector(pubkey) << std::vector<unsigned char>(redeemScript.begin(), redeemScript.end());
+
+    const MutableTransactionSignatureChecker checker(&txSpend, 0, txCredit.vout[0].nValue);
+    while (state.KeepRunning()) {
+        ScriptError err;
+        bool success = VerifyScript(txSpend.vin[0].scriptSig, scriptPubKey, &txSpend.vin[0].scriptWitness, flags, checker, &err);
+        assert(err == SCRIPT_ERR_OK);
+        assert(success);
+    }
+}
+
 static void VerifyNestedIfScript(benchmark::State& state) {
     std::vector<std::vector<unsigned char>> stack;
     CScript script;
@@ -93,5 +185,8 @@ static void VerifyNestedIfScript(benchmark::State& state) {
 
 
 BENCHMARK(VerifyScriptBench, 6300);
+BENCHMARK(VerifyScriptP2PKHBench, 6300);
+BENCHMARK(VerifyScriptP2PKHInterpreterBench, 6300);
+BENCHMARK(VerifyScriptTicketBench, 6300);
 
 BENCHMARK(VerifyNestedIfScript, 100);
@@ -0,0 +1,61 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockcache.h>
+
+#include <primitives/block.h>
+
+std::list<RecentBlockCache::Entry>::iterator RecentBlockCache::Find(const uint256& hash)
+{
+    auto it = m_entries.begin();
+    while (it != m_entries.end() && it->hash != hash) ++it;
+    if (it != m_entries.end() && it != m_entries.begin()) {
+        m_entries.splice(m_entries.begin(), m_entries, it);
+    }
+    return it;
+}
+
+void RecentBlockCache::Add(std::shared_ptr<const CBlock> block)
+{
+    const uint256 hash = block->GetHash();
+    LOCK(m_mutex);
+    auto it = Find(hash);
+    if (it != m_entries.end()) {
+        it->block = std::move(block);
+        return;
+    }
+    m_entries.push_front(Entry{hash, std::move(block), nullptr});
+    while (m_entries.size() > m_max_blocks) {
+        m_entries.pop_back();
+    }
+}
+
+void RecentBlockCache::AddSerialized(const uint256& hash, std::shared_ptr<const std::vector<uint8_t>> data)
+{
+    LOCK(m_mutex);
+    auto it = Find(hash);
+    if (it != m_entries.end()) {
+        it->serialized = std::move(data);
+    }
+}
+
+std::shared_ptr<const CBlock> RecentBlockCache::GetBlock(const uint256& hash)
+{
+    LOCK(m_mutex);
+    auto it = Find(hash);
+    return it != m_entries.end() ? it->block : nullptr;
+}
+
+std::shared_ptr<const std::vector<uint8_t>> RecentBlockCache::GetSerialized(const uint256& hash)
+{
+    LOCK(m_mutex);
+    auto it = Find(hash);
+    return it != m_entries.end() ? it->serialized : nullptr;
+}
+
+void RecentBlockCache::Clear()
+{
+    LOCK(m_mutex);
+    m_entries.clear();
+}
@@ -0,0 +1,59 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCACHE_H
+#define BITCOIN_BLOCKCACHE_H
+
+#include <sync.h>
+#include <uint256.h>
+
+#include <list>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+class CBlock;
+
+/**
+ * Least-recently-used cache of recently connected blocks, both as CBlock and
+ * in serialized (disk and witness network) format. Peers, REST and RPC asking
+ * for the latest blocks all tend to want the same few blocks, which this lets
+ * us serve without reading and deserializing them from disk every time.
+ */
+class RecentBlockCache
+{
+public:
+    explicit RecentBlockCache(size_t max_blocks) : m_max_blocks(max_blocks) {}
+
+    /** Add a block, evicting the least recently used one if the cache is full. */
+    void Add(std::shared_ptr<const CBlock> block);
+
+    /** Attach the serialized form of a cached block, e.g. once it has been read
+     *  from disk. Does nothing if the block is not (or no longer) cached. */
+    void AddSerialized(const uint256& hash, std::shared_ptr<const std::vector<uint8_t>> data);
+
+    /** Returns nullptr if the block is not cached. */
+    std::shared_ptr<const CBlock> GetBlock(const uint256& hash);
+    /** Returns nullptr if the block, or its serialized form, is not cached. */
+    std::shared_ptr<const std::vector<uint8_t>> GetSerialized(const uint256& hash);
+
+    void Clear();
+
+private:
+    struct Entry {
+        uint256 hash;
+        std::shared_ptr<const CBlock> block;
+        std::shared_ptr<const std::vector<uint8_t>> serialized;
+    };
+
+    const size_t m_max_blocks;
+    Mutex m_mutex;
+    //! Most recently used first. Only a handful of blocks are cached, so a
+    //! linear search beats maintaining an index.
+    std::list<Entry> m_entries GUARDED_BY(m_mutex);
+
+    std::list<Entry>::iterator Find(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+};
+
+#endif // BITCOIN_BLOCKCACHE_H
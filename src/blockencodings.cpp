@@ -14,7 +14,7 @@
 #include <validation.h>
 #include <util/system.h>
 
-#include <unordered_map>
+#include <algorithm>
 
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
@@ -44,6 +44,70 @@ uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const {
     return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
 }
 
+void CBlockHeaderAndShortTxIDs::GetShortIDs(const uint256* const* txhashes, size_t count, uint64_t* shortids) const {
+    SipHashUint256Multi(shorttxidk0, shorttxidk1, txhashes, count, shortids);
+    for (size_t i = 0; i < count; i++) {
+        shortids[i] &= 0xffffffffffffL;
+    }
+}
+
+namespace {
+
+/** The short IDs of a compact block, sorted, with their positions in the block.
+ *  A bitmap over the low bits of the IDs rejects most transactions that are not
+ *  in the block without a search; the others take a binary search through an
+ *  array that stays in cache. Unlike with a hash table, the cost of a lookup does
+ *  not depend on which short IDs the peer picked. */
+class ShortIDIndex
+{
+private:
+    std::vector<std::pair<uint64_t, uint16_t>> m_ids;
+    std::vector<uint64_t> m_filter;
+    uint64_t m_filter_mask;
+
+public:
+    /** Returns false if two transactions in the block have the same short ID. */
+    bool Init(const std::vector<uint64_t>& shorttxids, const std::vector<CTransactionRef>& txn_available)
+    {
+        m_ids.reserve(shorttxids.size());
+        uint16_t index_offset = 0;
+        for (size_t i = 0; i < shorttxids.size(); i++) {
+            while (txn_available[i + index_offset])
+                index_offset++;
+            m_ids.emplace_back(shorttxids[i], i + index_offset);
+        }
+        std::sort(m_ids.begin(), m_ids.end());
+        for (size_t i = 1; i < m_ids.size(); i++) {
+            if (m_ids[i].first == m_ids[i - 1].first) return false;
+        }
+
+        // At least 16 bits per ID, for a false positive rate of at most 1/16.
+        size_t filter_bits = 64;
+        while (filter_bits < 16 * m_ids.size()) filter_bits <<= 1;
+        m_filter.assign(filter_bits / 64, 0);
+        m_filter_mask = filter_bits - 1;
+        for (const auto& id : m_ids) {
+            const uint64_t bit = id.first & m_filter_mask;
+            m_filter[bit >> 6] |= uint64_t{1} << (bit & 63);
+        }
+        return true;
+    }
+
+    /** The position in the block of the transaction with this short ID, or -1. */
+    int Find(uint64_t shortid) const
+    {
+        const uint64_t bit = shortid & m_filter_mask;
+        if (!((m_filter[bit >> 6] >> (bit & 63)) & 1)) return -1;
+        auto it = std::lower_bound(m_ids.begin(), m_ids.end(), std::make_pair(shortid, uint16_t{0}));
+        if (it == m_ids.end() || it->first != shortid) return -1;
+        return it->second;
+    }
+
+    size_t size() const { return m_ids.size(); }
+};
+
+} // namespace
+
 
 
 ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn) {
@@ -74,71 +138,59 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     }
     prefilled_count = cmpctblock.prefilledtxn.size();
 
-    // Calculate map of txids -> positions and check mempool to see what we have (or don't)
-    // Because well-formed cmpctblock messages will have a (relatively) uniform distribution
-    // of short IDs, any highly-uneven distribution of elements can be safely treated as a
-    // READ_STATUS_FAILED.
-    std::unordered_map<uint64_t, uint16_t> shorttxids(cmpctblock.shorttxids.size());
-    uint16_t index_offset = 0;
-    for (size_t i = 0; i < cmpctblock.shorttxids.size(); i++) {
-        while (txn_available[i + index_offset])
-            index_offset++;
-        shorttxids[cmpctblock.shorttxids[i]] = i + index_offset;
-        // To determine the chance that the number of entries in a bucket exceeds N,
-        // we use the fact that the number of elements in a single bucket is
-        // binomially distributed (with n = the number of shorttxids S, and p =
-        // 1 / the number of buckets), that in the worst case the number of buckets is
-        // equal to S (due to std::unordered_map having a default load factor of 1.0),
-        // and that the chance for any bucket to exceed N elements is at most
-        // buckets * (the chance that any given bucket is above N elements).
-        // Thus: P(max_elements_per_bucket > N) <= S * (1 - cdf(binomial(n=S,p=1/S), N)).
-        // If we assume blocks of up to 16000, allowing 12 elements per bucket should
-        // only fail once per ~1 million block transfers (per peer and connection).
-        if (shorttxids.bucket_size(shorttxids.bucket(cmpctblock.shorttxids[i])) > 12)
-            return READ_STATUS_FAILED;
-    }
+    // Calculate the index of short IDs -> positions and check mempool to see what we have (or don't)
+    ShortIDIndex shorttxids;
     // TODO: in the shortid-collision case, we should instead request both transactions
     // which collided. Falling back to full-block-request here is overkill.
-    if (shorttxids.size() != cmpctblock.shorttxids.size())
+    if (!shorttxids.Init(cmpctblock.shorttxids, txn_available))
         return READ_STATUS_FAILED; // Short ID collision
 
     std::vector<bool> have_txn(txn_available.size());
     {
     LOCK(pool->cs);
     const std::vector<std::pair<uint256, CTxMemPool::txiter> >& vTxHashes = pool->vTxHashes;
-    for (size_t i = 0; i < vTxHashes.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(vTxHashes[i].first);
-        std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
-        if (idit != shorttxids.end()) {
-            if (!have_txn[idit->second]) {
-                txn_available[idit->second] = vTxHashes[i].second->GetSharedTx();
-                have_txn[idit->second]  = true;
-                mempool_count++;
-            } else {
-                // If we find two mempool txn that match the short id, just request it.
-                // This should be rare enough that the extra bandwidth doesn't matter,
-                // but eating a round-trip due to FillBlock failure would be annoying
-                if (txn_available[idit->second]) {
-                    txn_available[idit->second].reset();
-                    mempool_count--;
+    // Hashing the mempool is most of the work here; do it in batches.
+    static constexpr size_t BATCH_SIZE = 64;
+    const uint256* batch_hashes[BATCH_SIZE];
+    uint64_t batch_shortids[BATCH_SIZE];
+    for (size_t begin = 0; begin < vTxHashes.size() && mempool_count < shorttxids.size(); begin += BATCH_SIZE) {
+        const size_t batch_size = std::min(BATCH_SIZE, vTxHashes.size() - begin);
+        for (size_t j = 0; j < batch_size; j++) {
+            batch_hashes[j] = &vTxHashes[begin + j].first;
+        }
+        cmpctblock.GetShortIDs(batch_hashes, batch_size, batch_shortids);
+        for (size_t j = 0; j < batch_size; j++) {
+            const int idx = shorttxids.Find(batch_shortids[j]);
+            if (idx >= 0) {
+                if (!have_txn[idx]) {
+                    txn_available[idx] = vTxHashes[begin + j].second->GetSharedTx();
+                    have_txn[idx]  = true;
+                    mempool_count++;
+                } else {
+                    // If we find two mempool txn that match the short id, just request it.
+                    // This should be rare enough that the extra bandwidth doesn't matter,
+                    // but eating a round-trip due to FillBlock failure would be annoying
+                    if (txn_available[idx]) {
+                        txn_available[idx].reset();
+                        mempool_count--;
+                    }
                 }
             }
+            // Though ideally we'd continue scanning for the two-txn-match-shortid case,
+            // the performance win of an early exit here is too good to pass up and worth
+            // the extra risk.
+            if (mempool_count == shorttxids.size())
+                break;
         }
-        // Though ideally we'd continue scanning for the two-txn-match-shortid case,
-        // the performance win of an early exit here is too good to pass up and worth
-        // the extra risk.
-        if (mempool_count == shorttxids.size())
-            break;
     }
     }
 
     for (size_t i = 0; i < extra_txn.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(extra_txn[i].first);
-        std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
-        if (idit != shorttxids.end()) {
-            if (!have_txn[idit->second]) {
-                txn_available[idit->second] = extra_txn[i].second;
-                have_txn[idit->second]  = true;
+        const int idx = shorttxids.Find(cmpctblock.GetShortID(extra_txn[i].first));
+        if (idx >= 0) {
+            if (!have_txn[idx]) {
+                txn_available[idx] = extra_txn[i].second;
+                have_txn[idx]  = true;
                 mempool_count++;
                 extra_count++;
             } else {
@@ -148,9 +200,9 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
                 // but eating a round-trip due to FillBlock failure would be annoying
                 // Note that we don't want duplication between extra_txn and mempool to
                 // trigger this case, so we compare witness hashes first
-                if (txn_available[idit->second] &&
-                        txn_available[idit->second]->GetWitnessHash() != extra_txn[i].second->GetWitnessHash()) {
-                    txn_available[idit->second].reset();
+                if (txn_available[idx] &&
+                        txn_available[idx]->GetWitnessHash() != extra_txn[i].second->GetWitnessHash()) {
+                    txn_available[idx].reset();
                     mempool_count--;
                     extra_count--;
                 }
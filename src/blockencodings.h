@@ -106,6 +106,8 @@ public:
     CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
 
     uint64_t GetShortID(const uint256& txhash) const;
+    /** Same as GetShortID() for count hashes at once, which is faster for many. */
+    void GetShortIDs(const uint256* const* txhashes, size_t count, uint64_t* shortids) const;
 
     size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
 
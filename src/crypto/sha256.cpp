@@ -24,11 +24,21 @@ namespace sha256d64_sse41
 void Transform_4way(unsigned char* out, const unsigned char* in);
 }
 
+namespace sha256_sse41
+{
+void Transform_4way(uint32_t* s, const unsigned char* const* chunks);
+}
+
 namespace sha256d64_avx2
 {
 void Transform_8way(unsigned char* out, const unsigned char* in);
 }
 
+namespace sha256_avx2
+{
+void Transform_8way(uint32_t* s, const unsigned char* const* chunks);
+}
+
 namespace sha256d64_shani
 {
 void Transform_2way(unsigned char* out, const unsigned char* in);
@@ -416,6 +426,8 @@ void TransformD64(unsigned char* out, const unsigned char* in)
 
 typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
 typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+/** Transform N independent states (stored consecutively) with one chunk each. */
+typedef void (*TransformMultiType)(uint32_t*, const unsigned char* const*);
 
 template<TransformType tr>
 void TransformD64Wrapper(unsigned char* out, const unsigned char* in)
@@ -461,6 +473,8 @@ TransformD64Type TransformD64 = sha256::TransformD64;
 TransformD64Type TransformD64_2way = nullptr;
 TransformD64Type TransformD64_4way = nullptr;
 TransformD64Type TransformD64_8way = nullptr;
+TransformMultiType TransformMulti_4way = nullptr;
+TransformMultiType TransformMulti_8way = nullptr;
 
 bool SelfTest() {
     // Input state (equal to the initial SHA256 state)
@@ -544,9 +558,89 @@ bool SelfTest() {
         if (!std::equal(out, out + 256, result_d64)) return false;
     }
 
+    // Test TransformMulti_4way and TransformMulti_8way, if available. Lane i
+    // starts from the state after i chunks and processes chunk i.
+    const unsigned char* chunks[8];
+    uint32_t states[64];
+    for (size_t i = 0; i < 8; ++i) {
+        chunks[i] = data + 1 + 64 * i;
+    }
+    if (TransformMulti_4way) {
+        for (size_t i = 0; i < 4; ++i) std::copy(result[i], result[i] + 8, states + 8 * i);
+        TransformMulti_4way(states, chunks);
+        for (size_t i = 0; i < 4; ++i) {
+            if (!std::equal(states + 8 * i, states + 8 * i + 8, result[i + 1])) return false;
+        }
+    }
+    if (TransformMulti_8way) {
+        for (size_t i = 0; i < 8; ++i) std::copy(result[i], result[i] + 8, states + 8 * i);
+        TransformMulti_8way(states, chunks);
+        for (size_t i = 0; i < 8; ++i) {
+            if (!std::equal(states + 8 * i, states + 8 * i + 8, result[i + 1])) return false;
+        }
+    }
+
     return true;
 }
 
+/** One message being double-SHA256'd by SHA256DMulti, as a sequence of chunks
+ *  for a single lane of a multi-way transform. */
+struct MultiLane
+{
+    //! Remaining full chunks of the message, read in place.
+    const unsigned char* data;
+    size_t data_chunks;
+    //! The padded final chunk(s) of the message.
+    unsigned char tail[128];
+    size_t tail_chunks;
+    size_t tail_pos;
+    //! Whether this is the outer hash over the inner hash's output.
+    bool outer;
+    //! Index of the message, and of its output.
+    size_t index;
+
+    void Start(uint32_t* s, const unsigned char* in, size_t len, bool outer_in, size_t index_in)
+    {
+        sha256::Initialize(s);
+        data = in;
+        data_chunks = len / 64;
+        const size_t rem = len % 64;
+        memset(tail, 0, sizeof(tail));
+        memcpy(tail, in + 64 * data_chunks, rem);
+        tail[rem] = 0x80;
+        tail_chunks = rem < 56 ? 1 : 2;
+        tail_pos = 0;
+        WriteBE64(tail + 64 * tail_chunks - 8, uint64_t(len) << 3);
+        outer = outer_in;
+        index = index_in;
+    }
+
+    bool Done() const { return data_chunks == 0 && tail_pos == tail_chunks; }
+
+    const unsigned char* Next()
+    {
+        if (data_chunks) {
+            --data_chunks;
+            data += 64;
+            return data - 64;
+        }
+        return tail + 64 * tail_pos++;
+    }
+
+    /** Called when Done(): start the outer hash, or write the result and return true. */
+    bool Finish(uint32_t* s, unsigned char* output)
+    {
+        unsigned char hash[CSHA256::OUTPUT_SIZE];
+        for (int i = 0; i < 8; ++i) WriteBE32(hash + 4 * i, s[i]);
+        if (outer) {
+            memcpy(output + 32 * index, hash, sizeof(hash));
+            return true;
+        }
+        Start(s, hash, sizeof(hash), true, index);
+        return false;
+    }
+};
+
 #if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
 /** Check whether the OS has enabled AVX registers. */
 bool AVXEnabled()
@@ -611,6 +705,7 @@ std::string SHA256AutoDetect()
 #endif
 #if defined(ENABLE_SSE41) && !defined(BUILD_BITCOIN_INTERNAL)
         TransformD64_4way = sha256d64_sse41::Transform_4way;
+        TransformMulti_4way = sha256_sse41::Transform_4way;
         ret += ",sse41(4way)";
 #endif
     }
@@ -618,6 +713,7 @@ std::string SHA256AutoDetect()
 #if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
     if (have_avx2 && have_avx && enabled_avx) {
         TransformD64_8way = sha256d64_avx2::Transform_8way;
+        TransformMulti_8way = sha256_avx2::Transform_8way;
         ret += ",avx2(8way)";
     }
 #endif
@@ -717,3 +813,49 @@ void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
         --blocks;
     }
 }
+
+void SHA256DMulti(unsigned char* output, const unsigned char* const* inputs, const size_t* lengths, size_t count)
+{
+    const TransformMultiType tr = TransformMulti_8way ? TransformMulti_8way : TransformMulti_4way;
+    const size_t ways = TransformMulti_8way ? 8 : 4;
+    size_t next = 0;
+    if (tr && count >= ways) {
+        MultiLane lanes[8];
+        uint32_t states[64];
+        const unsigned char* chunks[8];
+        bool busy[8];
+        for (size_t i = 0; i < ways; ++i, ++next) {
+            lanes[i].Start(states + 8 * i, inputs[next], lengths[next], false, next);
+            busy[i] = true;
+        }
+        // Run all lanes in parallel as long as there is work for every one of
+        // them, refilling a lane with the next message once it completes.
+        bool all_busy = true;
+        while (all_busy) {
+            for (size_t i = 0; i < ways; ++i) chunks[i] = lanes[i].Next();
+            tr(states, chunks);
+            for (size_t i = 0; i < ways; ++i) {
+                if (!lanes[i].Done() || !lanes[i].Finish(states + 8 * i, output)) continue;
+                if (next < count) {
+                    lanes[i].Start(states + 8 * i, inputs[next], lengths[next], false, next);
+                    ++next;
+                } else {
+                    busy[i] = false;
+                    all_busy = false;
+                }
+            }
+        }
+        // Complete the remaining lanes one chunk at a time.
+        for (size_t i = 0; i < ways; ++i) {
+            if (!busy[i]) continue;
+            do {
+                while (!lanes[i].Done()) Transform(states + 8 * i, lanes[i].Next(), 1);
+            } while (!lanes[i].Finish(states + 8 * i, output));
+        }
+    }
+    for (; next < count; ++next) {
+        unsigned char hash[CSHA256::OUTPUT_SIZE];
+        CSHA256().Write(inputs[next], lengths[next]).Finalize(hash);
+        CSHA256().Write(hash, sizeof(hash)).Finalize(output + 32 * next);
+    }
+}
@@ -2,8 +2,19 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
 #include <crypto/siphash.h>
 
+#include <compat/cpuid.h>
+
+namespace siphash_avx2
+{
+void SipHashUint256_4way(uint64_t k0, uint64_t k1, const uint256* const* vals, uint64_t* out);
+}
+
 #define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
 
 #define SIPROUND do { \
@@ -171,3 +182,42 @@ uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint3
     SIPROUND;
     return v0 ^ v1 ^ v2 ^ v3;
 }
+
+namespace {
+
+typedef void (*SipHashUint256_4wayFn)(uint64_t k0, uint64_t k1, const uint256* const* vals, uint64_t* out);
+
+SipHashUint256_4wayFn SelectSipHashUint256_4way()
+{
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL) && defined(USE_ASM) && defined(HAVE_GETCPUID)
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    const bool have_avx = ((ecx >> 27) & 1) && ((ecx >> 28) & 1);
+    if (have_avx) {
+        // Check that the OS saves the AVX registers (XCR0 bits 1 and 2).
+        uint32_t a, d;
+        __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+        GetCPUID(7, 0, eax, ebx, ecx, edx);
+        if ((a & 6) == 6 && ((ebx >> 5) & 1)) return siphash_avx2::SipHashUint256_4way;
+    }
+#endif
+    return nullptr;
+}
+
+} // namespace
+
+void SipHashUint256Multi(uint64_t k0, uint64_t k1, const uint256* const* vals, size_t count, uint64_t* out)
+{
+    static const SipHashUint256_4wayFn hash_4way = SelectSipHashUint256_4way();
+    if (hash_4way) {
+        while (count >= 4) {
+            hash_4way(k0, k1, vals, out);
+            vals += 4;
+            out += 4;
+            count -= 4;
+        }
+    }
+    while (count--) {
+        *out++ = SipHashUint256(k0, k1, **vals++);
+    }
+}
@@ -5,6 +5,7 @@
 #ifndef BITCOIN_CRYPTO_SIPHASH_H
 #define BITCOIN_CRYPTO_SIPHASH_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include <uint256.h>
@@ -44,4 +45,8 @@ public:
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
 
+/** Compute out[i] = SipHashUint256(k0, k1, *vals[i]) for i in [0, count),
+ *  hashing four values at once with AVX2 where the CPU supports it. */
+void SipHashUint256Multi(uint64_t k0, uint64_t k1, const uint256* const* vals, size_t count, uint64_t* out);
+
 #endif // BITCOIN_CRYPTO_SIPHASH_H
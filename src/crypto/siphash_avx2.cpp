@@ -0,0 +1,71 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include <uint256.h>
+
+namespace siphash_avx2 {
+namespace {
+
+__m256i inline K(uint64_t x) { return _mm256_set1_epi64x(x); }
+
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi64(x, y); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+template <int b>
+__m256i inline RotL(__m256i x) { return _mm256_or_si256(_mm256_slli_epi64(x, b), _mm256_srli_epi64(x, 64 - b)); }
+/** Rotating a 64-bit lane by 32 bits is a swap of its two halves. */
+__m256i inline RotL32(__m256i x) { return _mm256_shuffle_epi32(x, 0xB1); }
+
+/** One SipRound on four independent states. */
+void inline __attribute__((always_inline)) Round(__m256i& v0, __m256i& v1, __m256i& v2, __m256i& v3)
+{
+    v0 = Add(v0, v1); v1 = RotL<13>(v1); v1 = Xor(v1, v0);
+    v0 = RotL32(v0);
+    v2 = Add(v2, v3); v3 = RotL<16>(v3); v3 = Xor(v3, v2);
+    v0 = Add(v0, v3); v3 = RotL<21>(v3); v3 = Xor(v3, v0);
+    v2 = Add(v2, v1); v1 = RotL<17>(v1); v1 = Xor(v1, v2);
+    v2 = RotL32(v2);
+}
+
+/** Gather the w'th 64-bit word of each of the four values. */
+__m256i inline Load(const uint256* const* vals, int w)
+{
+    return _mm256_set_epi64x(vals[3]->GetUint64(w), vals[2]->GetUint64(w), vals[1]->GetUint64(w), vals[0]->GetUint64(w));
+}
+
+} // namespace
+
+void SipHashUint256_4way(uint64_t k0, uint64_t k1, const uint256* const* vals, uint64_t* out)
+{
+    __m256i v0 = K(0x736f6d6570736575ULL ^ k0);
+    __m256i v1 = K(0x646f72616e646f6dULL ^ k1);
+    __m256i v2 = K(0x6c7967656e657261ULL ^ k0);
+    __m256i v3 = K(0x7465646279746573ULL ^ k1);
+
+    for (int w = 0; w < 4; ++w) {
+        __m256i d = Load(vals, w);
+        v3 = Xor(v3, d);
+        Round(v0, v1, v2, v3);
+        Round(v0, v1, v2, v3);
+        v0 = Xor(v0, d);
+    }
+    v3 = Xor(v3, K(((uint64_t)4) << 59));
+    Round(v0, v1, v2, v3);
+    Round(v0, v1, v2, v3);
+    v0 = Xor(v0, K(((uint64_t)4) << 59));
+    v2 = Xor(v2, K(0xFF));
+    Round(v0, v1, v2, v3);
+    Round(v0, v1, v2, v3);
+    Round(v0, v1, v2, v3);
+    Round(v0, v1, v2, v3);
+    _mm256_storeu_si256((__m256i*)out, Xor(Xor(v0, v1), Xor(v2, v3)));
+}
+
+} // namespace siphash_avx2
+
+#endif
@@ -477,6 +477,20 @@ public:
             }
         return false;
     }
+
+    /** for_each calls f on every element which has not been marked for
+     * garbage collection, e.g. to persist the cache contents. Not threadsafe
+     * with a concurrent insert or erase.
+     *
+     * @param f the function to call with each live element
+     */
+    template <typename F>
+    void for_each(F f) const
+    {
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                f(table[i]);
+    }
 };
 } // namespace CuckooCache
 
@@ -3,13 +3,49 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <algorithm>
+#include <map>
 #include <stdexcept>
 
 #include <flatfile.h>
 #include <logging.h>
+#include <sync.h>
 #include <tinyformat.h>
 #include <util/system.h>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+/** Maximum number of files kept mapped, across all sequences. Bounds the
+ *  address space used, as every block file can be up to 128 MiB. */
+constexpr size_t MAX_MAPPED_FILES = 64;
+
+struct MappedFile {
+    std::shared_ptr<const FlatFileMapping> mapping;
+    uint64_t last_used;
+};
+
+/** Mappings are cached by path rather than per FlatFileSeq, as sequences are
+ *  cheap objects that are routinely constructed for a single access. */
+Mutex g_mapped_files_mutex;
+std::map<fs::path, MappedFile> g_mapped_files GUARDED_BY(g_mapped_files_mutex);
+uint64_t g_mapped_files_counter GUARDED_BY(g_mapped_files_mutex) = 0;
+
+} // namespace
+
+FlatFileMapping::~FlatFileMapping()
+{
+#ifndef WIN32
+    munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+}
+
 FlatFileSeq::FlatFileSeq(fs::path dir, const char* prefix, size_t chunk_size) :
     m_dir(std::move(dir)),
     m_prefix(prefix),
@@ -52,6 +88,63 @@ FILE* FlatFileSeq::Open(const FlatFilePos& pos, bool read_only)
     return file;
 }
 
+std::shared_ptr<const FlatFileMapping> FlatFileSeq::Map(const FlatFilePos& pos, size_t size)
+{
+#ifdef WIN32
+    return nullptr;
+#else
+    // Mapping whole block files would exhaust a 32-bit address space.
+    if (pos.IsNull() || sizeof(void*) < 8) {
+        return nullptr;
+    }
+    const uint64_t end = (uint64_t)pos.nPos + size;
+    const fs::path path = FileName(pos);
+
+    LOCK(g_mapped_files_mutex);
+    auto it = g_mapped_files.find(path);
+    if (it != g_mapped_files.end() && it->second.mapping->size() >= end) {
+        it->second.last_used = ++g_mapped_files_counter;
+        return it->second.mapping;
+    }
+
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0 || (uint64_t)st.st_size < end) {
+        close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        LogPrintf("Unable to map file %s\n", path.string());
+        return nullptr;
+    }
+    auto mapping = std::make_shared<const FlatFileMapping>(static_cast<const unsigned char*>(data), st.st_size);
+
+    if (it != g_mapped_files.end()) {
+        it->second = MappedFile{mapping, ++g_mapped_files_counter};
+        return mapping;
+    }
+    if (g_mapped_files.size() >= MAX_MAPPED_FILES) {
+        auto lru = std::min_element(g_mapped_files.begin(), g_mapped_files.end(), [](const std::pair<const fs::path, MappedFile>& a, const std::pair<const fs::path, MappedFile>& b) {
+            return a.second.last_used < b.second.last_used;
+        });
+        g_mapped_files.erase(lru);
+    }
+    g_mapped_files.emplace(path, MappedFile{mapping, ++g_mapped_files_counter});
+    return mapping;
+#endif
+}
+
+void FlatFileSeq::Unmap(const FlatFilePos& pos)
+{
+    LOCK(g_mapped_files_mutex);
+    g_mapped_files.erase(FileName(pos));
+}
+
 size_t FlatFileSeq::Allocate(const FlatFilePos& pos, size_t add_size, bool& out_of_space)
 {
     out_of_space = false;
@@ -84,9 +177,13 @@ bool FlatFileSeq::Flush(const FlatFilePos& pos, bool finalize)
     if (!file) {
         return error("%s: failed to open file %d", __func__, pos.nFile);
     }
-    if (finalize && !TruncateFile(file, pos.nPos)) {
-        fclose(file);
-        return error("%s: failed to truncate file %d", __func__, pos.nFile);
+    if (finalize) {
+        // Reads past the new end of a mapping would fault rather than fail.
+        Unmap(pos);
+        if (!TruncateFile(file, pos.nPos)) {
+            fclose(file);
+            return error("%s: failed to truncate file %d", __func__, pos.nFile);
+        }
     }
     if (!FileCommit(file)) {
         fclose(file);
@@ -6,10 +6,13 @@
 #ifndef BITCOIN_FLATFILE_H
 #define BITCOIN_FLATFILE_H
 
+#include <assert.h>
+#include <memory>
 #include <string>
 
 #include <fs.h>
 #include <serialize.h>
+#include <span.h>
 
 struct FlatFilePos
 {
@@ -45,6 +48,34 @@ struct FlatFilePos
     std::string ToString() const;
 };
 
+/**
+ * A read-only memory mapping of a file in a FlatFileSeq. The mapped bytes stay
+ * valid for as long as the mapping is referenced, even if the file is later
+ * remapped, truncated or removed.
+ */
+class FlatFileMapping
+{
+private:
+    const unsigned char* const m_data;
+    const size_t m_size;
+
+public:
+    FlatFileMapping(const unsigned char* data, size_t size) : m_data(data), m_size(size) {}
+    ~FlatFileMapping();
+
+    FlatFileMapping(const FlatFileMapping&) = delete;
+    FlatFileMapping& operator=(const FlatFileMapping&) = delete;
+
+    size_t size() const { return m_size; }
+
+    /** Get len bytes at offset pos. The range must lie within the mapping. */
+    Span<const unsigned char> Get(size_t pos, size_t len) const
+    {
+        assert(pos <= m_size && len <= m_size - pos);
+        return Span<const unsigned char>(m_data + pos, len);
+    }
+};
+
 /**
  * FlatFileSeq represents a sequence of numbered files storing raw data. This class facilitates
  * access to and efficient management of these files.
@@ -72,6 +103,19 @@ public:
     /** Open a handle to the file at the given position. */
     FILE* Open(const FlatFilePos& pos, bool read_only = false);
 
+    /**
+     * Get a read-only memory mapping of the file at the given position that covers at least size
+     * bytes from pos. Mappings are shared between all users of a file and kept around for reuse;
+     * a file is remapped when it grew beyond its mapping.
+     *
+     * @return The mapping, or nullptr if the range is not in the file or memory mapping is not
+     *         supported on this platform. Callers then fall back to Open().
+     */
+    std::shared_ptr<const FlatFileMapping> Map(const FlatFilePos& pos, size_t size);
+
+    /** Drop any cached mapping of the file at the given position, e.g. before removing it. */
+    void Unmap(const FlatFilePos& pos);
+
     /**
      * Allocate additional space in a file after the given starting position. The amount allocated
      * will be the minimum multiple of the sequence chunk size greater than add_size.
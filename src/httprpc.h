@@ -30,4 +30,16 @@ void InterruptREST();
  */
 void StopREST();
 
+/** Start serving metrics in the Prometheus format at /metrics.
+ * Precondition; HTTP and RPC has been started.
+ */
+void StartHTTPMetrics();
+/** Interrupt the metrics endpoint.
+ */
+void InterruptHTTPMetrics();
+/** Stop serving metrics.
+ * Precondition; HTTP and RPC has been stopped.
+ */
+void StopHTTPMetrics();
+
 #endif
@@ -38,7 +38,7 @@
 namespace interfaces {
 namespace {
 
-class LockImpl : public Chain::Lock, public UniqueLock<RecursiveMutex>
+class LockImpl : public Chain::Lock, public UniqueLock<HoldTimedRecursiveMutex>
 {
     Optional<int> getHeight() override
     {
@@ -83,12 +83,19 @@ void BlockAssembler::resetBlock()
     // These counters do not include coinbase tx
     nBlockTx = 0;
     nFees = 0;
+    minPackageFeeRate = CFeeRate(MAX_MONEY);
 }
 
 Optional<int64_t> BlockAssembler::m_last_block_num_txs{nullopt};
 Optional<int64_t> BlockAssembler::m_last_block_weight{nullopt};
 
 std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, const CTransactionRef ticketTx)
+{
+    TemplateSelection selection;
+    return CreateNewBlock(scriptPubKeyIn, ticketTx, selection, {});
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, const CTransactionRef ticketTx, TemplateSelection& selection, const std::vector<uint256>& added)
 {
     int64_t nTimeStart = GetTimeMicros();
 
@@ -140,9 +147,29 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
         pblocktemplate->vTxSigOpsCost.push_back(0); // updated at end
     }
     
+    const size_t nFixedTx = pblock->vtx.size();
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    const bool fExtended = addSelectedTxs(selection, added, pindexPrev->GetBlockHash(), nPackagesSelected, nDescendantsUpdated);
+    if (!fExtended) {
+        // Select from the whole mempool, dropping whatever was added
+        const bool fWitness = fIncludeWitness;
+        resetBlock();
+        fIncludeWitness = fWitness;
+        pblock->vtx.resize(nFixedTx);
+        pblocktemplate->vTxFees.resize(nFixedTx);
+        pblocktemplate->vTxSigOpsCost.resize(nFixedTx);
+        nPackagesSelected = 0;
+        nDescendantsUpdated = 0;
+        addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    }
+
+    selection.hashPrevBlock = pindexPrev->GetBlockHash();
+    selection.txids.clear();
+    for (size_t i = nFixedTx; i < pblock->vtx.size(); ++i) {
+        selection.txids.push_back(pblock->vtx[i]->GetHash());
+    }
+    selection.minPackageFeeRate = minPackageFeeRate;
 
     int64_t nTime1 = GetTimeMicros();
 
@@ -191,7 +218,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     }*/
     int64_t nTime2 = GetTimeMicros();
 
-    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants, %s), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, fExtended ? "extended" : "from scratch", 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
 }
@@ -256,6 +283,15 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
 int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded,
         indexed_modified_transaction_set &mapModifiedTx)
 {
+    // Nothing else in the mempool descends from a package that is a whole
+    // cluster.
+    if (!alreadyAdded.empty()) {
+        const CTxMemPool::Cluster& cluster = m_mempool.GetCluster(*alreadyAdded.begin());
+        if (cluster.members.size() == alreadyAdded.size() &&
+            std::all_of(alreadyAdded.begin(), alreadyAdded.end(), [&](CTxMemPool::txiter it) { return &m_mempool.GetCluster(it) == &cluster; })) {
+            return 0;
+        }
+    }
     int nDescendantsUpdated = 0;
     for (CTxMemPool::txiter it : alreadyAdded) {
         CTxMemPool::setEntries descendants;
@@ -316,7 +352,7 @@ void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, std::ve
 // Each time through the loop, we compare the best transaction in
 // mapModifiedTxs with the next transaction in the mempool to decide what
 // transaction package to work on next.
-void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated)
+bool BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated, const CTxMemPool::setEntries* newTx)
 {
     // mapModifiedTx will store sorted packages after they are modified
     // because some of their txs are already in the block
@@ -329,6 +365,17 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     UpdatePackagesForAdded(inBlock, mapModifiedTx);
 
     CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = m_mempool.mapTx.get<ancestor_score>().begin();
+    if (newTx) {
+        // Everything else in mapTx was considered for the previous selection
+        // already, with more room left in the block. The new transactions
+        // without ancestors in the block have their mapTx ancestor state.
+        for (CTxMemPool::txiter it : *newTx) {
+            if (!inBlock.count(it) && !mapModifiedTx.count(it)) {
+                mapModifiedTx.insert(CTxMemPoolModifiedEntry(it));
+            }
+        }
+        mi = m_mempool.mapTx.get<ancestor_score>().end();
+    }
     CTxMemPool::txiter iter;
 
     // Limit the number of attempts to add transactions to the block when it is
@@ -386,10 +433,15 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
 
         if (packageFees < blockMinFeeRate.GetFee(packageSize)) {
             // Everything else we might consider has a lower fee rate
-            return;
+            return true;
         }
 
         if (!TestPackage(packageSize, packageSigOpsCost)) {
+            if (newTx && newTx->count(iter) && minPackageFeeRate < CFeeRate(packageFees, packageSize)) {
+                // Selecting from scratch would have considered this package
+                // while there was still room for it.
+                return false;
+            }
             if (fUsingModified) {
                 // Since we always look at the best entry in mapModifiedTx,
                 // we must erase failed entries so that we can consider the
@@ -439,10 +491,97 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         }
 
         ++nPackagesSelected;
+        minPackageFeeRate = std::min(minPackageFeeRate, CFeeRate(packageFees, packageSize));
 
         // Update transactions that depend on each of these
         nDescendantsUpdated += UpdatePackagesForAdded(ancestors, mapModifiedTx);
     }
+    return true;
+}
+
+bool BlockAssembler::addSelectedTxs(const TemplateSelection& selection, const std::vector<uint256>& added, const uint256& hashPrevBlock, int& nPackagesSelected, int& nDescendantsUpdated)
+{
+    if (selection.hashPrevBlock.IsNull() || selection.hashPrevBlock != hashPrevBlock) {
+        return false;
+    }
+
+    // With the same tip, the previous selection is still valid as long as all
+    // of it is still in the mempool, as it includes the unconfirmed ancestors
+    // of everything in it.
+    std::vector<CTxMemPool::txiter> previous;
+    previous.reserve(selection.txids.size());
+    for (const uint256& txid : selection.txids) {
+        CTxMemPool::txiter it = m_mempool.mapTx.find(txid);
+        if (it == m_mempool.mapTx.end()) {
+            return false;
+        }
+        previous.push_back(it);
+    }
+    CTxMemPool::setEntries newTx;
+    for (const uint256& txid : added) {
+        CTxMemPool::txiter it = m_mempool.mapTx.find(txid);
+        if (it != m_mempool.mapTx.end()) {
+            newTx.insert(it);
+        }
+    }
+
+    for (CTxMemPool::txiter it : previous) {
+        AddToBlock(it);
+    }
+    minPackageFeeRate = selection.minPackageFeeRate;
+    return addPackageTxs(nPackagesSelected, nDescendantsUpdated, &newTx);
+}
+
+BlockTemplateBuilder::BlockTemplateBuilder(const CTxMemPool& mempool, const CChainParams& params, const BlockAssembler::Options& options)
+    : m_mempool(mempool),
+      m_chainparams(params),
+      m_options(options)
+{
+}
+
+BlockTemplateBuilder::BlockTemplateBuilder(const CTxMemPool& mempool, const CChainParams& params)
+    : BlockTemplateBuilder(mempool, params, DefaultOptions()) {}
+
+std::unique_ptr<CBlockTemplate> BlockTemplateBuilder::CreateNewBlock(const CScript& scriptPubKeyIn, const CTransactionRef ticketTx)
+{
+    LOCK(m_mutex);
+    std::vector<uint256> added;
+    added.swap(m_added);
+    std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(m_mempool, m_chainparams, m_options).CreateNewBlock(scriptPubKeyIn, ticketTx, m_selection, added);
+    m_selected.clear();
+    m_selected.insert(m_selection.txids.begin(), m_selection.txids.end());
+    return pblocktemplate;
+}
+
+void BlockTemplateBuilder::Reset()
+{
+    LOCK(m_mutex);
+    m_selection = TemplateSelection();
+    m_selected.clear();
+    m_added.clear();
+}
+
+void BlockTemplateBuilder::TransactionAddedToMempool(const CTransactionRef& tx)
+{
+    LOCK(m_mutex);
+    if (m_selection.hashPrevBlock.IsNull()) return;
+    if (m_added.size() >= MAX_NEW_TXS) {
+        m_selection = TemplateSelection();
+        m_selected.clear();
+        m_added.clear();
+        return;
+    }
+    m_added.push_back(tx->GetHash());
+}
+
+void BlockTemplateBuilder::TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason)
+{
+    LOCK(m_mutex);
+    if (m_selected.count(tx->GetHash())) {
+        m_selection = TemplateSelection();
+        m_selected.clear();
+        m_added.clear();
+    }
 }
 
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
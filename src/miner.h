@@ -8,11 +8,14 @@
 
 #include <optional.h>
 #include <primitives/block.h>
+#include <sync.h>
 #include <txmempool.h>
 #include <validation.h>
+#include <validationinterface.h>
 
 #include <memory>
 #include <stdint.h>
+#include <unordered_set>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -33,6 +36,18 @@ struct CBlockTemplate
     std::vector<unsigned char> vchCoinbaseCommitment;
 };
 
+/** The mempool transactions of a block template, kept to build the next
+ *  template for the same tip from */
+struct TemplateSelection
+{
+    //! The block the transactions were selected on top of
+    uint256 hashPrevBlock;
+    //! The selected transactions, in block order
+    std::vector<uint256> txids;
+    //! The lowest ancestor feerate among the selected packages
+    CFeeRate minPackageFeeRate;
+};
+
 // Container for tracking updates to ancestor feerate as we include (parent)
 // transactions in a block
 struct CTxMemPoolModifiedEntry {
@@ -142,6 +157,7 @@ private:
     uint64_t nBlockSigOpsCost;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    CFeeRate minPackageFeeRate;
 
     // Chain context for the block
     int nHeight;
@@ -161,6 +177,11 @@ public:
 
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, const CTransactionRef ticketTx = nullptr);
+    /** Construct a new block template like above. If selection was made for
+      * the current tip, it is extended with the transactions in added (and
+      * their ancestors) rather than selecting from the whole mempool again.
+      * selection is updated to describe the new template. */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, const CTransactionRef ticketTx, TemplateSelection& selection, const std::vector<uint256>& added);
 
     static Optional<int64_t> m_last_block_num_txs;
     static Optional<int64_t> m_last_block_weight;
@@ -175,8 +196,16 @@ private:
     // Methods for how to add transactions to a block.
     /** Add transactions based on feerate including unconfirmed ancestors
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
-      * statistics from the package selection (for logging statistics). */
-    void addPackageTxs(int& nPackagesSelected, int& nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+      * statistics from the package selection (for logging statistics).
+      * If newTx is given, the transactions already in the block are a previous
+      * selection, and only newTx and the descendants of the block are
+      * considered. Returns false if one of newTx should have been selected
+      * ahead of packages already in the block. */
+    bool addPackageTxs(int& nPackagesSelected, int& nDescendantsUpdated, const CTxMemPool::setEntries* newTx = nullptr) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+    /** Add the transactions of a previous selection made for hashPrevBlock,
+      * then the best packages among the added transactions. Returns false if
+      * the selection can not be extended and has to be made from scratch. */
+    bool addSelectedTxs(const TemplateSelection& selection, const std::vector<uint256>& added, const uint256& hashPrevBlock, int& nPackagesSelected, int& nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
@@ -199,6 +228,46 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set& mapModifiedTx) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
 };
 
+/**
+ * Builds block templates for the current tip one after the other, extending
+ * the transaction selection of the previous template with the transactions
+ * that entered the mempool since, instead of walking the whole mempool each
+ * time. The selection is made from scratch again when the tip changes, when
+ * one of its transactions leaves the mempool, or when a new transaction would
+ * have displaced some of it.
+ */
+class BlockTemplateBuilder final : public CValidationInterface
+{
+public:
+    //! Beyond this many new transactions, selecting from scratch is as cheap
+    static constexpr size_t MAX_NEW_TXS = 20000;
+
+    BlockTemplateBuilder(const CTxMemPool& mempool, const CChainParams& params);
+    BlockTemplateBuilder(const CTxMemPool& mempool, const CChainParams& params, const BlockAssembler::Options& options);
+
+    /** Construct a new block template with coinbase to scriptPubKeyIn */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, const CTransactionRef ticketTx = nullptr);
+
+    /** Forget the previous selection, e.g. because fees of transactions it
+     *  considered were prioritised */
+    void Reset();
+
+protected:
+    void TransactionAddedToMempool(const CTransactionRef& tx) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason) override;
+
+private:
+    const CTxMemPool& m_mempool;
+    const CChainParams& m_chainparams;
+    const BlockAssembler::Options m_options;
+
+    Mutex m_mutex;
+    TemplateSelection m_selection GUARDED_BY(m_mutex);
+    std::unordered_set<uint256, SaltedTxidHasher> m_selected GUARDED_BY(m_mutex);
+    //! Transactions added to the mempool since m_selection was made
+    std::vector<uint256> m_added GUARDED_BY(m_mutex);
+};
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
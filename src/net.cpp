@@ -15,6 +15,7 @@
 #include <consensus/consensus.h>
 #include <crypto/sha256.h>
 #include <netbase.h>
+#include <netmetrics.h>
 #include <net_permissions.h>
 #include <random.h>
 #include <scheduler.h>
@@ -32,6 +33,10 @@
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/upnpcommands.h>
@@ -41,6 +46,7 @@
 static_assert(MINIUPNPC_API_VERSION >= 10, "miniUPnPc API version >= 10 assumed");
 #endif
 
+#include <array>
 #include <unordered_map>
 
 #include <math.h>
@@ -75,6 +81,9 @@ enum BindFlags {
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+/** Maximum number of queued buffers handed to a single sendmsg() call */
+static const size_t MAX_SEND_IOVECS = 64;
+
 const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
@@ -465,9 +474,10 @@ void CNode::CloseSocketDisconnect()
 }
 
 void CConnman::AddWhitelistPermissionFlags(NetPermissionFlags& flags, const CNetAddr &addr) const {
-    for (const auto& subnet : vWhitelistedRange) {
-        if (subnet.m_subnet.Match(addr)) NetPermissions::AddFlag(flags, subnet.m_flags);
-    }
+    m_whitelisted_ranges.ForEachMatch(addr, [&](NetPermissionFlags range_flags) {
+        NetPermissions::AddFlag(flags, range_flags);
+        return false;
+    });
 }
 
 std::string CNode::GetAddrName() const {
@@ -498,7 +508,7 @@ void CNode::SetAddrLocal(const CService& addrLocalIn) {
 
 #undef X
 #define X(name) stats.name = name
-void CNode::copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap)
+void CNode::copyStats(CNodeStats &stats, const Asmap &m_asmap)
 {
     stats.nodeid = this->GetId();
     X(nServices);
@@ -532,6 +542,7 @@ void CNode::copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap)
     {
         LOCK(cs_vRecv);
         X(mapRecvBytesPerMsgCmd);
+        X(mapRecvTimePerMsgCmd);
         X(nRecvBytes);
     }
     X(m_legacyWhitelisted);
@@ -581,20 +592,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
         nBytes -= handled;
 
         if (m_deserializer->Complete()) {
-            // decompose a transport agnostic CNetMessage from the deserializer
-            CNetMessage msg = m_deserializer->GetMessage(Params().MessageStart(), nTimeMicros);
-
-            //store received bytes per message command
-            //to prevent a memory DOS, only allow valid commands
-            mapMsgCmdSize::iterator i = mapRecvBytesPerMsgCmd.find(msg.m_command);
-            if (i == mapRecvBytesPerMsgCmd.end())
-                i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
-            assert(i != mapRecvBytesPerMsgCmd.end());
-            i->second += msg.m_raw_message_size;
-
-            // push the message to the process queue,
-            vRecvMsg.push_back(std::move(msg));
-
+            CompleteMessage(nTimeMicros);
             complete = true;
         }
     }
@@ -602,6 +600,46 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
     return true;
 }
 
+void CNode::ReceivedPayloadBytes(unsigned int nBytes, bool& complete)
+{
+    complete = false;
+    int64_t nTimeMicros = GetTimeMicros();
+    nLastRecv = nTimeMicros / 1000000;
+    nRecvBytes += nBytes;
+    m_deserializer->PayloadReceived(nBytes);
+    if (m_deserializer->Complete()) {
+        CompleteMessage(nTimeMicros);
+        complete = true;
+    }
+}
+
+void CNode::CompleteMessage(int64_t nTimeMicros)
+{
+    // decompose a transport agnostic CNetMessage from the deserializer
+    CNetMessage msg = m_deserializer->GetMessage(Params().MessageStart(), nTimeMicros);
+
+    //store received bytes per message command
+    //to prevent a memory DOS, only allow valid commands
+    mapMsgCmdSize::iterator i = mapRecvBytesPerMsgCmd.find(msg.m_command);
+    if (i == mapRecvBytesPerMsgCmd.end())
+        i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+    assert(i != mapRecvBytesPerMsgCmd.end());
+    i->second += msg.m_raw_message_size;
+
+    // push the message to the process queue,
+    vRecvMsg.push_back(std::move(msg));
+}
+
+void CNode::RecordProcessTime(const std::string& msg_type, int64_t nMicros)
+{
+    LOCK(cs_vRecv);
+    mapMsgCmdSize::iterator i = mapRecvTimePerMsgCmd.find(msg_type);
+    if (i == mapRecvTimePerMsgCmd.end())
+        i = mapRecvTimePerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+    assert(i != mapRecvTimePerMsgCmd.end());
+    i->second += nMicros;
+}
+
 void CNode::SetSendVersion(int nVersionIn)
 {
     // Send version may only be changed in the version message, and
@@ -677,6 +715,28 @@ int V1TransportDeserializer::readData(const char *pch, unsigned int nBytes)
     return nCopy;
 }
 
+Span<unsigned char> V1TransportDeserializer::GetPayloadBuffer(unsigned int max_bytes)
+{
+    if (!in_data || Complete()) return {};
+
+    // Grow the buffer by at most what has been received so far (or 256 KiB),
+    // so that announcing a large message does not make us allocate much more
+    // than the peer actually sent. It ends up exactly the size of the payload.
+    unsigned int nBytes = std::min({hdr.nMessageSize - nDataPos, max_bytes, std::max(nDataPos, 256U * 1024)});
+    if (vRecv.size() < nDataPos + nBytes) {
+        vRecv.resize(nDataPos + nBytes);
+    }
+    return Span<unsigned char>(reinterpret_cast<unsigned char*>(&vRecv[nDataPos]), nBytes);
+}
+
+void V1TransportDeserializer::PayloadReceived(unsigned int nBytes)
+{
+    assert(in_data && nDataPos + nBytes <= vRecv.size());
+    // Hash the bytes right away, while they are still in cache.
+    hasher.Write(reinterpret_cast<const unsigned char*>(&vRecv[nDataPos]), nBytes);
+    nDataPos += nBytes;
+}
+
 const uint256& V1TransportDeserializer::GetMessageHash() const
 {
     assert(Complete());
@@ -720,10 +780,11 @@ CNetMessage V1TransportDeserializer::GetMessage(const CMessageHeader::MessageSta
 
 void V1TransportSerializer::prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) {
     // create dbl-sha256 checksum
-    uint256 hash = Hash(msg.data.begin(), msg.data.end());
+    const Span<const unsigned char> payload = msg.Payload();
+    uint256 hash = Hash(payload.begin(), payload.end());
 
     // create header
-    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), msg.data.size());
+    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), payload.size());
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
     // serialize header
@@ -737,27 +798,53 @@ size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pno
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
-        int nBytes = 0;
+        assert((*it)->size() > pnode->nSendOffset);
+        ssize_t nBytes = 0;
+        size_t nRequested = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+            const auto& data = **it;
+            nRequested = data.size() - pnode->nSendOffset;
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, nRequested, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            // Hand as many queued buffers as possible to the kernel in one call.
+            std::array<struct iovec, MAX_SEND_IOVECS> iov;
+            size_t nIov = 0;
+            for (auto buf = it; buf != pnode->vSendMsg.end() && nIov < iov.size(); ++buf, ++nIov) {
+                const size_t offset = nIov == 0 ? pnode->nSendOffset : 0;
+                iov[nIov].iov_base = const_cast<unsigned char*>((*buf)->data() + offset);
+                iov[nIov].iov_len = (*buf)->size() - offset;
+                nRequested += iov[nIov].iov_len;
+            }
+            struct msghdr hdr{};
+            hdr.msg_iov = iov.data();
+            hdr.msg_iovlen = nIov;
+            nBytes = sendmsg(pnode->hSocket, &hdr, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // Pop the buffers that were sent completely.
+            size_t nLeft = nBytes;
+            while (nLeft > 0) {
+                const size_t nBufferLeft = (*it)->size() - pnode->nSendOffset;
+                if (nLeft < nBufferLeft) {
+                    pnode->nSendOffset += nLeft;
+                    break;
+                }
+                nLeft -= nBufferLeft;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= (*it)->size();
                 pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
                 it++;
-            } else {
-                // could not send full message; stop sending more
+            }
+            if ((size_t)nBytes < nRequested) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -1045,6 +1132,9 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+#ifdef USE_EPOLL
+        EpollRegister(pnode);
+#endif
     }
 
     // We received a new connection, harvest entropy from the time (and our peer count)
@@ -1080,6 +1170,9 @@ void CConnman::DisconnectNodes()
 
                 // close socket and cleanup
                 pnode->CloseSocketDisconnect();
+#ifdef USE_EPOLL
+                m_epoll_pending.erase(pnode);
+#endif
 
                 // hold in disconnected pool until all refs are released
                 pnode->Release();
@@ -1324,13 +1417,103 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_s
 }
 #endif
 
+/** Size of a single recv() from a peer's socket; typical socket buffer is 8K-64K */
+static const int SOCKET_RECV_CHUNK_SIZE = 0x10000;
+/** Upper bound on a single recv() into a message's payload buffer */
+static const unsigned int MAX_DIRECT_RECV_SIZE = 0x100000;
+
+int CConnman::SocketRecvData(CNode* pnode)
+{
+    int nBytes = 0;
+    bool notify = false;
+    bool direct = false;
+    {
+        // Once the header of a large message is in, receive its payload
+        // straight into the message buffer instead of copying it over.
+        LOCK(pnode->cs_vRecv);
+        const Span<unsigned char> payload = pnode->m_deserializer->GetPayloadBuffer(MAX_DIRECT_RECV_SIZE);
+        if (payload.size() >= SOCKET_RECV_CHUNK_SIZE) {
+            direct = true;
+            {
+                LOCK(pnode->cs_hSocket);
+                if (pnode->hSocket == INVALID_SOCKET)
+                    return 0;
+                nBytes = recv(pnode->hSocket, (char*)payload.data(), payload.size(), MSG_DONTWAIT);
+            }
+            if (nBytes > 0) {
+                pnode->ReceivedPayloadBytes(nBytes, notify);
+            }
+        }
+    }
+    if (!direct) {
+        char pchBuf[SOCKET_RECV_CHUNK_SIZE];
+        {
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                return 0;
+            nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+        }
+        if (nBytes > 0 && !pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
+            pnode->CloseSocketDisconnect();
+    }
+    if (nBytes > 0)
+    {
+        RecordBytesRecv(nBytes);
+        if (notify) {
+            size_t nSizeAdded = 0;
+            auto it(pnode->vRecvMsg.begin());
+            for (; it != pnode->vRecvMsg.end(); ++it) {
+                // vRecvMsg contains only completed CNetMessage
+                // the single possible partially deserialized message are held by TransportDeserializer
+                nSizeAdded += it->m_raw_message_size;
+            }
+            {
+                LOCK(pnode->cs_vProcessMsg);
+                pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
+                pnode->nProcessQueueSize += nSizeAdded;
+                pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
+            }
+            WakeMessageHandler(pnode);
+        }
+    }
+    else if (nBytes == 0)
+    {
+        // socket closed gracefully
+        if (!pnode->fDisconnect) {
+            LogPrint(BCLog::NET, "socket closed for peer=%d\n", pnode->GetId());
+        }
+        pnode->CloseSocketDisconnect();
+    }
+    else if (nBytes < 0)
+    {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+        {
+            if (!pnode->fDisconnect) {
+                LogPrint(BCLog::NET, "socket recv error for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(nErr));
+            }
+            pnode->CloseSocketDisconnect();
+        }
+    }
+    return nBytes;
+}
+
 void CConnman::SocketHandler()
 {
+#ifdef USE_EPOLL
+    if (m_epoll_fd != -1) {
+        EpollSocketHandler();
+        return;
+    }
+#endif
     std::set<SOCKET> recv_set, send_set, error_set;
     SocketEvents(recv_set, send_set, error_set);
 
     if (interruptNet) return;
 
+    ScopedLatencyTimer timer(GetNetMetrics().socket_handler_time);
+
     //
     // Accept new connections
     //
@@ -1373,58 +1556,7 @@ void CConnman::SocketHandler()
         }
         if (recvSet || errorSet)
         {
-            // typical socket buffer is 8K-64K
-            char pchBuf[0x10000];
-            int nBytes = 0;
-            {
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-            }
-            if (nBytes > 0)
-            {
-                bool notify = false;
-                if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
-                    pnode->CloseSocketDisconnect();
-                RecordBytesRecv(nBytes);
-                if (notify) {
-                    size_t nSizeAdded = 0;
-                    auto it(pnode->vRecvMsg.begin());
-                    for (; it != pnode->vRecvMsg.end(); ++it) {
-                        // vRecvMsg contains only completed CNetMessage
-                        // the single possible partially deserialized message are held by TransportDeserializer
-                        nSizeAdded += it->m_raw_message_size;
-                    }
-                    {
-                        LOCK(pnode->cs_vProcessMsg);
-                        pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
-                        pnode->nProcessQueueSize += nSizeAdded;
-                        pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
-                    }
-                    WakeMessageHandler();
-                }
-            }
-            else if (nBytes == 0)
-            {
-                // socket closed gracefully
-                if (!pnode->fDisconnect) {
-                    LogPrint(BCLog::NET, "socket closed for peer=%d\n", pnode->GetId());
-                }
-                pnode->CloseSocketDisconnect();
-            }
-            else if (nBytes < 0)
-            {
-                // error
-                int nErr = WSAGetLastError();
-                if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                {
-                    if (!pnode->fDisconnect) {
-                        LogPrint(BCLog::NET, "socket recv error for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(nErr));
-                    }
-                    pnode->CloseSocketDisconnect();
-                }
-            }
+            SocketRecvData(pnode);
         }
 
         //
@@ -1448,6 +1580,147 @@ void CConnman::SocketHandler()
     }
 }
 
+#ifdef USE_EPOLL
+/** Maximum number of readiness notifications taken from the kernel per wakeup */
+static const int EPOLL_MAX_EVENTS = 256;
+
+void CConnman::EpollRegister(CNode* pnode)
+{
+    if (m_epoll_fd == -1) return;
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET) return;
+    // Peer sockets are edge-triggered so that idle peers cost nothing per
+    // wakeup; the socket handler tracks which ones it has not drained yet.
+    struct epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+        LogPrintf("epoll_ctl failed for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(errno));
+        pnode->fDisconnect = true;
+    }
+}
+
+void CConnman::EpollSocketHandler()
+{
+    // Do not wait if a peer still has data we could read right away.
+    int timeout = SELECT_TIMEOUT_MILLISECONDS;
+    for (CNode* pnode : m_epoll_pending) {
+        if (pnode->fPauseRecv) continue;
+        LOCK(pnode->cs_vSend);
+        if (pnode->vSendMsg.empty()) {
+            timeout = 0;
+            break;
+        }
+    }
+
+    std::array<struct epoll_event, EPOLL_MAX_EVENTS> events;
+    int nEvents = epoll_wait(m_epoll_fd, events.data(), events.size(), timeout);
+
+    if (interruptNet) return;
+
+    ScopedLatencyTimer timer(GetNetMetrics().socket_handler_time);
+
+    if (nEvents < 0) {
+        if (errno != EINTR) {
+            LogPrintf("socket epoll error %s\n", NetworkErrorString(errno));
+            interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        }
+        nEvents = 0;
+    }
+
+    //
+    // Accept new connections and collect the peers that became ready
+    //
+    std::vector<CNode*> vNodesReady;
+    for (int i = 0; i < nEvents; ++i) {
+        const struct epoll_event& event = events[i];
+        const ListenSocket* listen_socket = nullptr;
+        for (const ListenSocket& hListenSocket : vhListenSocket) {
+            if (event.data.ptr == &hListenSocket) listen_socket = &hListenSocket;
+        }
+        if (listen_socket) {
+            if (listen_socket->socket != INVALID_SOCKET) AcceptConnection(*listen_socket);
+            continue;
+        }
+        CNode* pnode = static_cast<CNode*>(event.data.ptr);
+        if (event.events & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+            pnode->m_sock_readable = true;
+            m_epoll_pending.insert(pnode);
+        }
+        if (event.events & EPOLLOUT) {
+            pnode->m_sock_writable = true;
+            // Only needs servicing if something is waiting to be sent.
+            if (!pnode->m_sock_readable) vNodesReady.push_back(pnode);
+        }
+    }
+    vNodesReady.insert(vNodesReady.end(), m_epoll_pending.begin(), m_epoll_pending.end());
+
+    // Nodes are only deleted by this thread (in DisconnectNodes), so the
+    // pointers stay valid; take references like the select()/poll() path does.
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodesReady)
+            pnode->AddRef();
+    }
+
+    //
+    // Service each ready socket
+    //
+    for (CNode* pnode : vNodesReady)
+    {
+        if (interruptNet)
+            break;
+
+        // Drain the send queue before receiving more, as in GenerateSelectSet().
+        bool send_pending;
+        {
+            LOCK(pnode->cs_vSend);
+            if (pnode->m_sock_writable && !pnode->vSendMsg.empty()) {
+                size_t nBytes = SocketSendData(pnode);
+                if (nBytes) {
+                    RecordBytesSent(nBytes);
+                }
+            }
+            send_pending = !pnode->vSendMsg.empty();
+        }
+        // Anything left means the socket would block; wait for the next EPOLLOUT.
+        if (send_pending) pnode->m_sock_writable = false;
+
+        if (pnode->m_sock_readable && !send_pending && !pnode->fPauseRecv) {
+            // A short read means the kernel buffer is empty; a new edge will
+            // be reported once more data arrives.
+            if (SocketRecvData(pnode) < SOCKET_RECV_CHUNK_SIZE) {
+                pnode->m_sock_readable = false;
+            }
+        }
+        if (!pnode->m_sock_readable) m_epoll_pending.erase(pnode);
+    }
+
+    //
+    // Check all peers for inactivity, which has a granularity of seconds
+    //
+    std::vector<CNode*> vNodesCopy;
+    if (GetTimeMillis() >= m_next_inactivity_check) {
+        m_next_inactivity_check = GetTimeMillis() + 1000;
+        LOCK(cs_vNodes);
+        vNodesCopy = vNodes;
+        for (CNode* pnode : vNodesCopy)
+            pnode->AddRef();
+    }
+    for (CNode* pnode : vNodesCopy) {
+        InactivityCheck(pnode);
+    }
+
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodesReady)
+            pnode->Release();
+        for (CNode* pnode : vNodesCopy)
+            pnode->Release();
+    }
+}
+#endif
+
 void CConnman::ThreadSocketHandler()
 {
     while (!interruptNet)
@@ -1462,9 +1735,23 @@ void CConnman::WakeMessageHandler()
 {
     {
         std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        std::fill(m_msgproc_wake.begin(), m_msgproc_wake.end(), true);
     }
-    condMsgProc.notify_one();
+    condMsgProc.notify_all();
+}
+
+void CConnman::WakeMessageHandler(const CNode* pnode)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutexMsgProc);
+        m_msgproc_wake[MessageHandlerShard(pnode)] = true;
+    }
+    condMsgProc.notify_all();
+}
+
+int CConnman::MessageHandlerShard(const CNode* pnode) const
+{
+    return pnode->GetId() % m_msghandler_threads;
 }
 
 
@@ -2018,19 +2305,23 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+#ifdef USE_EPOLL
+        EpollRegister(pnode);
+#endif
     }
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(int shard)
 {
     while (!flagInterruptMsgProc)
     {
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy) {
+            for (CNode* pnode : vNodes) {
+                if (MessageHandlerShard(pnode) != shard) continue;
                 pnode->AddRef();
+                vNodesCopy.push_back(pnode);
             }
         }
 
@@ -2064,9 +2355,9 @@ void CConnman::ThreadMessageHandler()
 
         WAIT_LOCK(mutexMsgProc, lock);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
+            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this, shard] { return m_msgproc_wake[shard]; });
         }
-        fMsgProcWake = false;
+        m_msgproc_wake[shard] = false;
     }
 }
 
@@ -2278,6 +2569,25 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         return false;
     }
 
+#ifdef USE_EPOLL
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd == -1) {
+        LogPrintf("epoll_create1 failed, falling back to poll(): %s\n", NetworkErrorString(errno));
+    }
+    for (ListenSocket& hListenSocket : vhListenSocket) {
+        if (m_epoll_fd == -1) break;
+        // Level-triggered: AcceptConnection() takes one connection at a time.
+        struct epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = &hListenSocket;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0) {
+            LogPrintf("epoll_ctl failed for listening socket, falling back to poll(): %s\n", NetworkErrorString(errno));
+            close(m_epoll_fd);
+            m_epoll_fd = -1;
+        }
+    }
+#endif
+
     for (const auto& strDest : connOptions.vSeedNodes) {
         AddOneShot(strDest);
     }
@@ -2321,7 +2631,7 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
 
     {
         LOCK(mutexMsgProc);
-        fMsgProcWake = false;
+        m_msgproc_wake.assign(m_msghandler_threads, false);
     }
 
     // Send and receive from sockets, accept connections
@@ -2347,7 +2657,10 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this, connOptions.m_specified_outgoing)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int shard = 0; shard < m_msghandler_threads; ++shard) {
+        const std::string name = shard == 0 ? "msghand" : strprintf("msghand.%d", shard);
+        threadMessageHandlers.emplace_back([this, shard, name] { TraceThread(name.c_str(), std::bind(&CConnman::ThreadMessageHandler, this, shard)); });
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery([this] { DumpAddresses(); }, DUMP_PEERS_INTERVAL);
@@ -2396,8 +2709,11 @@ void CConnman::Interrupt()
 
 void CConnman::StopThreads()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (std::thread& thread : threadMessageHandlers) {
+        if (thread.joinable())
+            thread.join();
+    }
+    threadMessageHandlers.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2434,6 +2750,13 @@ void CConnman::StopNodes()
     vNodes.clear();
     vNodesDisconnected.clear();
     vhListenSocket.clear();
+#ifdef USE_EPOLL
+    m_epoll_pending.clear();
+    if (m_epoll_fd != -1) {
+        close(m_epoll_fd);
+        m_epoll_fd = -1;
+    }
+#endif
     semOutbound.reset();
     semAddnode.reset();
 }
@@ -2717,9 +3040,12 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
         m_tx_relay = MakeUnique<TxRelay>();
     }
 
-    for (const std::string &msg : getAllNetMessageTypes())
+    for (const std::string &msg : getAllNetMessageTypes()) {
         mapRecvBytesPerMsgCmd[msg] = 0;
+        mapRecvTimePerMsgCmd[msg] = 0;
+    }
     mapRecvBytesPerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
+    mapRecvTimePerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
 
     if (fLogIPs) {
         LogPrint(BCLog::NET, "Added connection to %s peer=%d\n", addrName, id);
@@ -2743,7 +3069,7 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
 
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 {
-    size_t nMessageSize = msg.data.size();
+    size_t nMessageSize = msg.Payload().size();
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command), nMessageSize, pnode->GetId());
 
     // make sure we use the appropriate network transport format
@@ -2762,13 +3088,17 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+        pnode->vSendMsg.push_back(std::make_shared<const std::vector<unsigned char>>(std::move(serializedHeader)));
+        if (nMessageSize) {
+            if (!msg.shared_data) msg.shared_data = std::make_shared<const std::vector<unsigned char>>(std::move(msg.data));
+            pnode->vSendMsg.push_back(std::move(msg.shared_data));
+        }
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
             nBytesSent = SocketSendData(pnode);
+
+        GetNetMetrics().send_queue_bytes.Record(pnode->nSendSize);
     }
     if (nBytesSent)
         RecordBytesSent(nBytesSent);
@@ -19,7 +19,9 @@
 #include <policy/feerate.h>
 #include <protocol.h>
 #include <random.h>
+#include <span.h>
 #include <streams.h>
+#include <subnettrie.h>
 #include <sync.h>
 #include <uint256.h>
 #include <threadinterrupt.h>
@@ -28,6 +30,7 @@
 #include <deque>
 #include <stdint.h>
 #include <thread>
+#include <unordered_set>
 #include <memory>
 #include <condition_variable>
 
@@ -89,6 +92,10 @@ static const int64_t DEFAULT_PEER_CONNECT_TIMEOUT = 60;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** Default number of message handler threads, peers are sharded across them by id */
+static const int DEFAULT_MSGHANDLER_THREADS = 1;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHANDLER_THREADS = 16;
 
 typedef int64_t NodeId;
 
@@ -113,7 +120,12 @@ struct CSerializedNetMsg
     CSerializedNetMsg& operator=(const CSerializedNetMsg&) = delete;
 
     std::vector<unsigned char> data;
+    /** Payload shared with other messages instead of owned, e.g. one serialized
+     *  block relayed to many peers. Takes the place of data when set. */
+    std::shared_ptr<const std::vector<unsigned char>> shared_data;
     std::string command;
+
+    Span<const unsigned char> Payload() const { return shared_data ? MakeSpan(*shared_data) : MakeSpan(data); }
 };
 
 
@@ -146,6 +158,7 @@ public:
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
         int64_t m_peer_connect_timeout = DEFAULT_PEER_CONNECT_TIMEOUT;
+        int m_msghandler_threads = DEFAULT_MSGHANDLER_THREADS;
         std::vector<std::string> vSeedNodes;
         std::vector<NetWhitelistPermissions> vWhitelistedRange;
         std::vector<NetWhitebindPermissions> vWhiteBinds;
@@ -172,12 +185,16 @@ public:
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
         m_peer_connect_timeout = connOptions.m_peer_connect_timeout;
+        m_msghandler_threads = std::max(1, std::min(connOptions.m_msghandler_threads, MAX_MSGHANDLER_THREADS));
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
             nMaxOutboundLimit = connOptions.nMaxOutboundLimit;
         }
-        vWhitelistedRange = connOptions.vWhitelistedRange;
+        m_whitelisted_ranges.Clear();
+        for (const NetWhitelistPermissions& range : connOptions.vWhitelistedRange) {
+            NetPermissions::AddFlag(m_whitelisted_ranges[range.m_subnet], range.m_flags);
+        }
         {
             LOCK(cs_vAddedNodes);
             vAddedNodes = connOptions.m_added_nodes;
@@ -320,7 +337,10 @@ public:
 
     unsigned int GetReceiveFloodSize() const;
 
+    /** Wake all message handler threads. */
     void WakeMessageHandler();
+    /** Wake the message handler thread that processes pnode. */
+    void WakeMessageHandler(const CNode* pnode);
 
     /** Attempts to obfuscate tx time through exponentially distributed emitting.
         Works assuming that a single interval is used.
@@ -328,7 +348,7 @@ public:
     */
     int64_t PoissonNextSendInbound(int64_t now, int average_interval_seconds);
 
-    void SetAsmap(std::vector<bool> asmap) { addrman.m_asmap = std::move(asmap); }
+    void SetAsmap(std::vector<bool> asmap) { addrman.m_asmap = Asmap(std::move(asmap)); }
 
 private:
     struct ListenSocket {
@@ -347,14 +367,20 @@ private:
     void AddOneShot(const std::string& strDest);
     void ProcessOneShot();
     void ThreadOpenConnections(std::vector<std::string> connect);
-    void ThreadMessageHandler();
+    int MessageHandlerShard(const CNode* pnode) const;
+    void ThreadMessageHandler(int shard);
     void AcceptConnection(const ListenSocket& hListenSocket);
     void DisconnectNodes();
     void NotifyNumConnectionsChanged();
     void InactivityCheck(CNode *pnode);
     bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+    int SocketRecvData(CNode* pnode);
     void SocketHandler();
+#ifdef USE_EPOLL
+    void EpollRegister(CNode* pnode) EXCLUSIVE_LOCKS_REQUIRED(cs_vNodes);
+    void EpollSocketHandler();
+#endif
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -398,14 +424,22 @@ private:
     // P2P timeout in seconds
     int64_t m_peer_connect_timeout;
 
-    // Whitelisted ranges. Any node connecting from these is automatically
-    // whitelisted (as well as those connecting to whitelisted binds).
-    std::vector<NetWhitelistPermissions> vWhitelistedRange;
+    // Whitelisted ranges, with the permissions of each. Any node connecting
+    // from these is automatically whitelisted (as well as those connecting to
+    // whitelisted binds).
+    SubNetTrie<NetPermissionFlags> m_whitelisted_ranges;
 
     unsigned int nSendBufferMaxSize{0};
     unsigned int nReceiveFloodSize{0};
 
     std::vector<ListenSocket> vhListenSocket;
+#ifdef USE_EPOLL
+    /** epoll instance the sockets are registered with, or -1 to fall back to poll(). */
+    int m_epoll_fd{-1};
+    /** Peers whose socket may still hold unread data. Only used by the socket handler thread. */
+    std::unordered_set<CNode*> m_epoll_pending;
+    int64_t m_next_inactivity_check{0};
+#endif
     std::atomic<bool> fNetworkActive{true};
     bool fAddressesInitialized{false};
     CAddrMan addrman;
@@ -456,8 +490,12 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /** Number of message handler threads; each processes the peers whose id
+     *  maps to its shard, so that a peer is only ever handled by one thread. */
+    int m_msghandler_threads{DEFAULT_MSGHANDLER_THREADS};
+
+    /** flags for waking the message processor, one per shard. */
+    std::vector<bool> m_msgproc_wake GUARDED_BY(mutexMsgProc);
 
     std::condition_variable condMsgProc;
     Mutex mutexMsgProc;
@@ -469,7 +507,7 @@ private:
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of m_max_outbound_full_relay
@@ -592,6 +630,8 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    // Microseconds spent processing messages, by message type
+    mapMsgCmdSize mapRecvTimePerMsgCmd;
     NetPermissionFlags m_permissionFlags;
     bool m_legacyWhitelisted;
     int64_t m_ping_usec;
@@ -644,6 +684,11 @@ public:
     virtual void SetVersion(int version) = 0;
     // read and deserialize data
     virtual int Read(const char *data, unsigned int bytes) = 0;
+    // buffer to receive up to max_bytes of the current message's payload into
+    // directly, instead of passing them to Read(); empty if no payload is due
+    virtual Span<unsigned char> GetPayloadBuffer(unsigned int max_bytes) = 0;
+    // account for bytes written into the buffer returned by GetPayloadBuffer()
+    virtual void PayloadReceived(unsigned int bytes) = 0;
     // decomposes a message from the context
     virtual CNetMessage GetMessage(const CMessageHeader::MessageStartChars& message_start, int64_t time) = 0;
     virtual ~TransportDeserializer() {}
@@ -698,6 +743,8 @@ public:
         if (ret < 0) Reset();
         return ret;
     }
+    Span<unsigned char> GetPayloadBuffer(unsigned int max_bytes) override;
+    void PayloadReceived(unsigned int nBytes) override;
     CNetMessage GetMessage(const CMessageHeader::MessageStartChars& message_start, int64_t time) override;
 };
 
@@ -731,7 +778,9 @@ public:
     size_t nSendSize{0}; // total size of all vSendMsg entries
     size_t nSendOffset{0}; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<unsigned char>> vSendMsg GUARDED_BY(cs_vSend);
+    // Buffers are reference counted so that a payload queued for several peers
+    // is only held in memory once.
+    std::deque<std::shared_ptr<const std::vector<unsigned char>>> vSendMsg GUARDED_BY(cs_vSend);
     RecursiveMutex cs_vSend;
     RecursiveMutex cs_hSocket;
     RecursiveMutex cs_vRecv;
@@ -784,18 +833,28 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv{false};
     std::atomic_bool fPauseSend{false};
+#ifdef USE_EPOLL
+    // Edge-triggered readiness of hSocket, only used by the socket handler
+    // thread: set on an epoll notification, cleared once recv()/send() would block.
+    bool m_sock_readable{false};
+    bool m_sock_writable{false};
+#endif
 
 protected:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd GUARDED_BY(cs_vRecv);
+    mapMsgCmdSize mapRecvTimePerMsgCmd GUARDED_BY(cs_vRecv);
 
 public:
     uint256 hashContinue;
     std::atomic<int> nStartingHeight{-1};
 
     // flood relay
-    std::vector<CAddress> vAddrToSend;
-    const std::unique_ptr<CRollingBloomFilter> m_addr_known;
+    // vAddrToSend and m_addr_known are also written by other peers' message
+    // handler threads when relaying addresses.
+    Mutex cs_addrSend;
+    std::vector<CAddress> vAddrToSend GUARDED_BY(cs_addrSend);
+    const std::unique_ptr<CRollingBloomFilter> m_addr_known PT_GUARDED_BY(cs_addrSend);
     bool fGetAddr{false};
     std::chrono::microseconds m_next_addr_send GUARDED_BY(cs_sendProcessing){0};
     std::chrono::microseconds m_next_local_addr_send GUARDED_BY(cs_sendProcessing){0};
@@ -820,9 +879,11 @@ public:
 
         mutable RecursiveMutex cs_tx_inventory;
         CRollingBloomFilter filterInventoryKnown GUARDED_BY(cs_tx_inventory){50000, 0.000001};
-        // Set of transaction ids we still have to announce.
-        // They are sorted by the mempool before relay, so the order is not important.
-        std::set<uint256> setInventoryTxToSend;
+        // Transaction ids we still have to announce, possibly with duplicates.
+        // They are deduplicated and sorted by the mempool before relay, so the
+        // order is not important. A flat vector takes a fraction of the memory
+        // of a node-based set, which adds up over many peers.
+        std::vector<uint256> vInventoryTxToSend GUARDED_BY(cs_tx_inventory);
         // Used for BIP35 mempool sending
         bool fSendMempool GUARDED_BY(cs_tx_inventory){false};
         // Last time a "MEMPOOL" request was serviced.
@@ -891,6 +952,9 @@ private:
     NetPermissionFlags m_permissionFlags{ PF_NONE };
     std::list<CNetMessage> vRecvMsg;  // Used only by SocketHandler thread
 
+    /** Move the message m_deserializer completed to vRecvMsg. */
+    void CompleteMessage(int64_t nTimeMicros) EXCLUSIVE_LOCKS_REQUIRED(cs_vRecv);
+
     mutable RecursiveMutex cs_addrName;
     std::string addrName GUARDED_BY(cs_addrName);
 
@@ -918,6 +982,10 @@ public:
     }
 
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
+    /** Account for nBytes received straight into m_deserializer->GetPayloadBuffer(). */
+    void ReceivedPayloadBytes(unsigned int nBytes, bool& complete) EXCLUSIVE_LOCKS_REQUIRED(cs_vRecv);
+    /** Account for nMicros spent processing a message of type msg_type. */
+    void RecordProcessTime(const std::string& msg_type, int64_t nMicros);
 
     void SetRecvVersion(int nVersionIn)
     {
@@ -950,6 +1018,7 @@ public:
     void AddAddressKnown(const CAddress& _addr)
     {
         assert(m_addr_known);
+        LOCK(cs_addrSend);
         m_addr_known->insert(_addr.GetKey());
     }
 
@@ -959,6 +1028,7 @@ public:
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
         assert(m_addr_known);
+        LOCK(cs_addrSend);
         if (_addr.IsValid() && !m_addr_known->contains(_addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand.randrange(vAddrToSend.size())] = _addr;
@@ -982,7 +1052,7 @@ public:
         if (inv.type == MSG_TX && m_tx_relay != nullptr) {
             LOCK(m_tx_relay->cs_tx_inventory);
             if (!m_tx_relay->filterInventoryKnown.contains(inv.hash)) {
-                m_tx_relay->setInventoryTxToSend.insert(inv.hash);
+                m_tx_relay->vInventoryTxToSend.push_back(inv.hash);
             }
         } else if (inv.type == MSG_BLOCK) {
             LOCK(cs_inventory);
@@ -998,7 +1068,7 @@ public:
 
     void CloseSocketDisconnect();
 
-    void copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap);
+    void copyStats(CNodeStats &stats, const Asmap &m_asmap);
 
     ServiceFlags GetLocalServices() const
     {
@@ -13,11 +13,12 @@
 
 class CTxMemPool;
 
-extern RecursiveMutex cs_main;
-extern RecursiveMutex g_cs_orphans;
+extern HoldTimedRecursiveMutex cs_main;
 
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -maxorphansize, maximum memory used by orphan transactions in kilobytes */
+static const unsigned int DEFAULT_MAX_ORPHAN_SIZE = 5000;
 /** Default number of orphan+recently-replaced txn to keep around for block reconstruction */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
 static const bool DEFAULT_PEERBLOOMFILTERS = false;
@@ -86,6 +87,10 @@ struct CNodeStateStats {
     int nSyncHeight = -1;
     int nCommonHeight = -1;
     std::vector<int> vHeightInFlight;
+    //! Microseconds from the peer announcing a block to it being connected,
+    //! for the last such block and on average, or -1 if there was none.
+    int64_t m_last_block_announce_latency = -1;
+    int64_t m_avg_block_announce_latency = -1;
 };
 
 /** Get statistics from node state */
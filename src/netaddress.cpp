@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <netaddress.h>
+#include <crypto/common.h>
 #include <hash.h>
 #include <util/strencodings.h>
 #include <util/asmap.h>
@@ -443,34 +444,21 @@ uint32_t CNetAddr::GetNetClass() const {
     return net_class;
 }
 
-uint32_t CNetAddr::GetMappedAS(const std::vector<bool> &asmap) const {
+uint32_t CNetAddr::GetMappedAS(const Asmap &asmap) const {
     uint32_t net_class = GetNetClass();
-    if (asmap.size() == 0 || (net_class != NET_IPV4 && net_class != NET_IPV6)) {
+    if (asmap.IsEmpty() || (net_class != NET_IPV4 && net_class != NET_IPV6)) {
         return 0; // Indicates not found, safe because AS0 is reserved per RFC7607.
     }
-    std::vector<bool> ip_bits(128);
+    unsigned char ip_bytes[16];
     if (HasLinkedIPv4()) {
         // For lookup, treat as if it was just an IPv4 address (pchIPv4 prefix + IPv4 bits)
-        for (int8_t byte_i = 0; byte_i < 12; ++byte_i) {
-            for (uint8_t bit_i = 0; bit_i < 8; ++bit_i) {
-                ip_bits[byte_i * 8 + bit_i] = (pchIPv4[byte_i] >> (7 - bit_i)) & 1;
-            }
-        }
-        uint32_t ipv4 = GetLinkedIPv4();
-        for (int i = 0; i < 32; ++i) {
-            ip_bits[96 + i] = (ipv4 >> (31 - i)) & 1;
-        }
+        memcpy(ip_bytes, pchIPv4, 12);
+        WriteBE32(ip_bytes + 12, GetLinkedIPv4());
     } else {
         // Use all 128 bits of the IPv6 address otherwise
-        for (int8_t byte_i = 0; byte_i < 16; ++byte_i) {
-            uint8_t cur_byte = GetByte(15 - byte_i);
-            for (uint8_t bit_i = 0; bit_i < 8; ++bit_i) {
-                ip_bits[byte_i * 8 + bit_i] = (cur_byte >> (7 - bit_i)) & 1;
-            }
-        }
+        memcpy(ip_bytes, ip, 16);
     }
-    uint32_t mapped_as = Interpret(asmap, ip_bits);
-    return mapped_as;
+    return asmap.Lookup(ip_bytes);
 }
 
 /**
@@ -483,7 +471,7 @@ uint32_t CNetAddr::GetMappedAS(const std::vector<bool> &asmap) const {
  * @note No two connections will be attempted to addresses with the same network
  *       group.
  */
-std::vector<unsigned char> CNetAddr::GetGroup(const std::vector<bool> &asmap) const
+std::vector<unsigned char> CNetAddr::GetGroup(const Asmap &asmap) const
 {
     std::vector<unsigned char> vchRet;
     uint32_t net_class = GetNetClass();
@@ -842,6 +830,27 @@ static inline int NetmaskBits(uint8_t x)
     }
 }
 
+int CSubNet::GetPrefixLength() const
+{
+    if (!valid)
+        return -1;
+    int bits = 0;
+    int n = 0;
+    for (; n < 16 && netmask[n] == 0xff; ++n)
+        bits += 8;
+    if (n < 16) {
+        const int byte_bits = NetmaskBits(netmask[n]);
+        if (byte_bits < 0)
+            return -1;
+        bits += byte_bits;
+        ++n;
+    }
+    for (; n < 16; ++n)
+        if (netmask[n] != 0x00)
+            return -1;
+    return bits;
+}
+
 std::string CSubNet::ToString() const
 {
     /* Parse binary 1{n}0{N-n} to see if mask can be represented as /n */
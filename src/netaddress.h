@@ -10,6 +10,7 @@
 #endif
 
 #include <compat.h>
+#include <util/asmap.h>
 #include <serialize.h>
 
 #include <stdint.h>
@@ -87,9 +88,9 @@ class CNetAddr
         // The AS on the BGP path to the node we use to diversify
         // peers in AddrMan bucketing based on the AS infrastructure.
         // The ip->AS mapping depends on how asmap is constructed.
-        uint32_t GetMappedAS(const std::vector<bool> &asmap) const;
+        uint32_t GetMappedAS(const Asmap &asmap) const;
 
-        std::vector<unsigned char> GetGroup(const std::vector<bool> &asmap) const;
+        std::vector<unsigned char> GetGroup(const Asmap &asmap) const;
         std::vector<unsigned char> GetAddrBytes() const { return {std::begin(ip), std::end(ip)}; }
         int GetReachabilityFrom(const CNetAddr *paddrPartner = nullptr) const;
 
@@ -133,6 +134,13 @@ class CSubNet
         std::string ToString() const;
         bool IsValid() const;
 
+        /** The number of leading one bits of the netmask, counting all 128 bits
+         *  of the address, or -1 if the subnet is invalid or its netmask is not
+         *  a prefix. */
+        int GetPrefixLength() const;
+        /** The network address, with the bits outside the netmask cleared */
+        const CNetAddr& GetNetwork() const { return network; }
+
         friend bool operator==(const CSubNet& a, const CSubNet& b);
         friend bool operator!=(const CSubNet& a, const CSubNet& b) { return !(a == b); }
         friend bool operator<(const CSubNet& a, const CSubNet& b);
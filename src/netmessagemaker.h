@@ -29,6 +29,24 @@ public:
         return Make(0, std::move(sCommand), std::forward<Args>(args)...);
     }
 
+    /** Serialize a payload once, so that it can be sent to several peers with
+     *  MakeShared() without being serialized or copied again. */
+    template <typename... Args>
+    std::shared_ptr<const std::vector<unsigned char>> MakePayload(int nFlags, Args&&... args) const
+    {
+        std::vector<unsigned char> data;
+        CVectorWriter{ SER_NETWORK, nFlags | nVersion, data, 0, std::forward<Args>(args)... };
+        return std::make_shared<const std::vector<unsigned char>>(std::move(data));
+    }
+
+    CSerializedNetMsg MakeShared(std::string sCommand, std::shared_ptr<const std::vector<unsigned char>> payload) const
+    {
+        CSerializedNetMsg msg;
+        msg.command = std::move(sCommand);
+        msg.shared_data = std::move(payload);
+        return msg;
+    }
+
 private:
     const int nVersion;
 };
@@ -0,0 +1,127 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <netmetrics.h>
+
+#include <crypto/common.h>
+#include <net.h>
+#include <protocol.h>
+#include <tinyformat.h>
+#include <util/time.h>
+
+#include <algorithm>
+
+void LogHistogram::Record(int64_t value)
+{
+    int bucket = 0;
+    if (value > 0) {
+        bucket = std::min<int>(CountBits(value), BUCKETS - 1);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+    }
+    m_counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+LogHistogram::Snapshot LogHistogram::GetSnapshot() const
+{
+    Snapshot snapshot;
+    for (int i = 0; i < BUCKETS; ++i) {
+        snapshot.counts[i] = m_counts[i].load(std::memory_order_relaxed);
+    }
+    snapshot.count = m_count.load(std::memory_order_relaxed);
+    snapshot.sum = m_sum.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+ScopedLatencyTimer::ScopedLatencyTimer(LogHistogram& histogram) : m_histogram(histogram), m_start(GetTimeMicros()) {}
+
+ScopedLatencyTimer::~ScopedLatencyTimer()
+{
+    m_histogram.Record(GetTimeMicros() - m_start);
+}
+
+ScopedHoldTimer::ScopedHoldTimer(LogHistogram& histogram) : m_histogram(histogram), m_start(HoldTimedRecursiveMutexBase::HeldMicros()) {}
+
+ScopedHoldTimer::~ScopedHoldTimer()
+{
+    m_histogram.Record(HoldTimedRecursiveMutexBase::HeldMicros() - m_start);
+}
+
+const std::string NetMetrics::SEND_MESSAGES{"*sendmessages*"};
+
+NetMetrics::NetMetrics()
+{
+    for (const std::string& msg_type : getAllNetMessageTypes()) {
+        process_time[msg_type];
+        cs_main_hold_time[msg_type];
+    }
+    process_time[NET_MESSAGE_COMMAND_OTHER];
+    cs_main_hold_time[NET_MESSAGE_COMMAND_OTHER];
+    cs_main_hold_time[SEND_MESSAGES];
+}
+
+LogHistogram& NetMetrics::ForMessageType(PerMessageType& map, const std::string& msg_type)
+{
+    auto it = map.find(msg_type);
+    if (it == map.end()) it = map.find(NET_MESSAGE_COMMAND_OTHER);
+    return it->second;
+}
+
+namespace {
+
+/** Append a histogram of microseconds (scale 1e-6, reported in seconds) or
+ *  of bytes (scale 1) in the Prometheus format. */
+void AppendHistogram(std::string& out, const std::string& name, const std::string& labels, const LogHistogram& histogram, double scale)
+{
+    const LogHistogram::Snapshot snapshot = histogram.GetSnapshot();
+    const std::string sep = labels.empty() ? "" : ",";
+    uint64_t cumulative = 0;
+    for (int i = 0; i < LogHistogram::BUCKETS - 1; ++i) {
+        cumulative += snapshot.counts[i];
+        out += strprintf("%s_bucket{%s%sle=\"%g\"} %u\n", name, labels, sep, LogHistogram::BucketLimit(i) * scale, cumulative);
+    }
+    out += strprintf("%s_bucket{%s%sle=\"+Inf\"} %u\n", name, labels, sep, snapshot.count);
+    const std::string braced = labels.empty() ? "" : "{" + labels + "}";
+    out += strprintf("%s_sum%s %g\n", name, braced, snapshot.sum * scale);
+    out += strprintf("%s_count%s %u\n", name, braced, snapshot.count);
+}
+
+void AppendPerMessageType(std::string& out, const std::string& name, const std::string& help, const NetMetrics::PerMessageType& map)
+{
+    out += strprintf("# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    for (const auto& entry : map) {
+        // Leave out message types never seen, which are most of them
+        if (entry.second.GetSnapshot().count == 0) continue;
+        AppendHistogram(out, name, strprintf("msgtype=\"%s\"", entry.first), entry.second, 1e-6);
+    }
+}
+
+void AppendSingle(std::string& out, const std::string& name, const std::string& help, const LogHistogram& histogram, double scale)
+{
+    out += strprintf("# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    AppendHistogram(out, name, "", histogram, scale);
+}
+
+} // namespace
+
+std::string NetMetrics::ToPrometheus() const
+{
+    std::string out;
+    AppendPerMessageType(out, "bitcoin_net_message_process_seconds", "Time spent processing a received message, by message type.", process_time);
+    AppendPerMessageType(out, "bitcoin_net_cs_main_hold_seconds", "Time cs_main was held while processing a received message, by message type, or while sending messages.", cs_main_hold_time);
+    AppendSingle(out, "bitcoin_net_send_messages_seconds", "Time spent sending messages to a peer.", send_messages_time, 1e-6);
+    AppendSingle(out, "bitcoin_net_socket_handler_seconds", "Time spent handling ready sockets.", socket_handler_time, 1e-6);
+    AppendSingle(out, "bitcoin_net_send_queue_bytes", "Size of a peer's send queue.", send_queue_bytes, 1);
+    AppendSingle(out, "bitcoin_net_block_announce_to_connect_seconds", "Time from a block first being announced to it being connected.", block_announce_to_connect_time, 1e-6);
+    return out;
+}
+
+NetMetrics& GetNetMetrics()
+{
+    // Leaked like the logger, so that it outlives any thread still recording
+    // at shutdown, and constructed on first use so that the message type lists
+    // it is built from are initialized first.
+    static NetMetrics* g_net_metrics{new NetMetrics()};
+    return *g_net_metrics;
+}
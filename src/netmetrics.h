@@ -0,0 +1,113 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NETMETRICS_H
+#define BITCOIN_NETMETRICS_H
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <stdint.h>
+#include <string>
+
+#include <sync.h>
+
+/**
+ * Histogram of non-negative values, such as durations in microseconds or sizes
+ * in bytes, in power-of-two buckets. Recording is a handful of relaxed atomic
+ * increments, cheap enough for the message handling hot paths.
+ */
+class LogHistogram
+{
+public:
+    /** Bucket 0 counts values below 1, bucket i > 0 values in [2^(i-1), 2^i).
+     *  The last bucket also counts everything larger. */
+    static constexpr int BUCKETS = 32;
+
+    LogHistogram() = default;
+    LogHistogram(const LogHistogram&) = delete;
+    LogHistogram& operator=(const LogHistogram&) = delete;
+
+    void Record(int64_t value);
+
+    struct Snapshot {
+        std::array<uint64_t, BUCKETS> counts{};
+        uint64_t count{0};
+        uint64_t sum{0};
+    };
+    /** The counters are read one at a time, so a snapshot taken while values
+     *  are recorded may be off by those values. */
+    Snapshot GetSnapshot() const;
+
+    /** Exclusive upper bound of the values counted in bucket i < BUCKETS - 1 */
+    static uint64_t BucketLimit(int i) { return uint64_t{1} << i; }
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> m_counts{};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_sum{0};
+};
+
+/** Records the microseconds from its construction to its destruction */
+class ScopedLatencyTimer
+{
+public:
+    explicit ScopedLatencyTimer(LogHistogram& histogram);
+    ~ScopedLatencyTimer();
+
+private:
+    LogHistogram& m_histogram;
+    const int64_t m_start;
+};
+
+/** Records the microseconds the calling thread held a HoldTimedRecursiveMutex
+ *  (cs_main) from its construction to its destruction */
+class ScopedHoldTimer
+{
+public:
+    explicit ScopedHoldTimer(LogHistogram& histogram);
+    ~ScopedHoldTimer();
+
+private:
+    LogHistogram& m_histogram;
+    const int64_t m_start;
+};
+
+/** Timing of the P2P code, exposed through getnetmetrics and /metrics. */
+class NetMetrics
+{
+public:
+    typedef std::map<std::string, LogHistogram> PerMessageType;
+
+    NetMetrics();
+
+    /** Microseconds spent in ProcessMessage, per message type */
+    PerMessageType process_time;
+    /** Microseconds cs_main was held while processing a message, per message
+     *  type, and while sending messages (SEND_MESSAGES) */
+    PerMessageType cs_main_hold_time;
+    /** Microseconds spent in SendMessages per peer */
+    LogHistogram send_messages_time;
+    /** Microseconds spent handling ready sockets, after waiting for them */
+    LogHistogram socket_handler_time;
+    /** Bytes in a peer's send queue, sampled whenever messages are sent to it */
+    LogHistogram send_queue_bytes;
+    /** Microseconds from a peer first announcing a block to it being connected */
+    LogHistogram block_announce_to_connect_time;
+
+    /** Key of the cs_main hold time of SendMessages */
+    static const std::string SEND_MESSAGES;
+
+    /** The histogram of msg_type in map, or that of unknown message types.
+     *  The maps are never modified after construction, so this needs no lock. */
+    static LogHistogram& ForMessageType(PerMessageType& map, const std::string& msg_type);
+
+    /** All metrics in the Prometheus text exposition format */
+    std::string ToPrometheus() const;
+};
+
+/** The global NetMetrics instance, constructed on first use */
+NetMetrics& GetNetMetrics();
+
+#endif // BITCOIN_NETMETRICS_H
@@ -83,3 +83,63 @@ TransactionError BroadcastTransaction(NodeContext& node, const CTransactionRef t
 
     return TransactionError::OK;
 }
+
+void BroadcastTransactions(NodeContext& node, const std::vector<CTransactionRef>& txs, std::vector<TransactionError>& errors, std::vector<std::string>& err_strings, const CFeeRate& max_tx_fee_rate)
+{
+    assert(node.connman);
+    assert(node.mempool);
+    errors.assign(txs.size(), TransactionError::OK);
+    err_strings.assign(txs.size(), std::string());
+    std::promise<void> promise;
+
+    { // cs_main scope
+    LOCK(cs_main);
+    // Transactions already confirmed are left out, as are those already in the
+    // mempool, which are relayed again.
+    CCoinsViewCache &view = ::ChainstateActive().CoinsTip();
+    std::vector<CTransactionRef> to_submit;
+    std::vector<size_t> submitted_pos;
+    for (size_t i = 0; i < txs.size(); ++i) {
+        const CTransaction& tx = *txs[i];
+        bool in_chain = false;
+        for (size_t o = 0; o < tx.vout.size() && !in_chain; o++) {
+            in_chain = !view.AccessCoin(COutPoint(tx.GetHash(), o)).IsSpent();
+        }
+        if (in_chain) {
+            errors[i] = TransactionError::ALREADY_IN_CHAIN;
+        } else if (!node.mempool->exists(tx.GetHash())) {
+            to_submit.push_back(txs[i]);
+            submitted_pos.push_back(i);
+        }
+    }
+
+    std::vector<TxValidationState> states;
+    AcceptToMemoryPoolBatch(*node.mempool, to_submit, states, nullptr /* plTxnReplaced */, max_tx_fee_rate);
+    for (size_t n = 0; n < states.size(); ++n) {
+        const TxValidationState& state = states[n];
+        if (state.IsValid()) continue;
+        const size_t i = submitted_pos[n];
+        err_strings[i] = state.ToString();
+        if (state.IsInvalid()) {
+            errors[i] = state.GetResult() == TxValidationResult::TX_MISSING_INPUTS ? TransactionError::MISSING_INPUTS : TransactionError::MEMPOOL_REJECTED;
+        } else {
+            errors[i] = TransactionError::MEMPOOL_ERROR;
+        }
+    }
+
+    // Make sure clients of the validation interface, such as the wallet, have
+    // been notified of the accepted transactions before returning, as
+    // BroadcastTransaction does with wait_callback.
+    CallFunctionInValidationInterfaceQueue([&promise] {
+        promise.set_value();
+    });
+    } // cs_main
+
+    promise.get_future().wait();
+
+    for (size_t i = 0; i < txs.size(); ++i) {
+        if (errors[i] == TransactionError::OK) {
+            RelayTransaction(txs[i]->GetHash(), *node.connman);
+        }
+    }
+}
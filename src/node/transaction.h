@@ -9,6 +9,10 @@
 #include <primitives/transaction.h>
 #include <util/error.h>
 
+#include <string>
+#include <vector>
+
+class CFeeRate;
 struct NodeContext;
 
 /**
@@ -30,4 +34,19 @@ struct NodeContext;
  */
 NODISCARD TransactionError BroadcastTransaction(NodeContext& node, CTransactionRef tx, std::string& err_string, const CAmount& max_tx_fee, bool relay, bool wait_callback);
 
+/**
+ * Submit several transactions to the mempool as one batch, see
+ * AcceptToMemoryPoolBatch, and relay those accepted to all P2P peers.
+ * Transactions may spend outputs of those before them. Waits until callbacks
+ * for the accepted transactions have been processed, so MUST NOT be called
+ * while cs_main, cs_mempool or cs_wallet are held.
+ *
+ * @param[in]  node reference to node context
+ * @param[in]  txs the transactions to broadcast
+ * @param[out] errors the error for each transaction, OK if it is in the mempool
+ * @param[out] err_strings the error string for each transaction, if available
+ * @param[in]  max_tx_fee_rate reject txs with fee rates higher than this (if 0, accept any fee rate)
+ */
+void BroadcastTransactions(NodeContext& node, const std::vector<CTransactionRef>& txs, std::vector<TransactionError>& errors, std::vector<std::string>& err_strings, const CFeeRate& max_tx_fee_rate);
+
 #endif // BITCOIN_NODE_TRANSACTION_H
@@ -0,0 +1 @@
+#define BUILD_SUFFIX b1a8b7e-dirty
@@ -12,6 +12,19 @@
 
 static constexpr double INF_FEERATE = 1e99;
 
+struct CBlockPolicyEstimator::SmartFeeTable
+{
+    struct Entry
+    {
+        CFeeRate feerate;
+        FeeCalculation calc;
+    };
+    unsigned int maxTarget;
+    // Indexed by target, up to the highest target with its own answer
+    std::vector<Entry> economical;
+    std::vector<Entry> conservative;
+};
+
 std::string StringForFeeEstimateHorizon(FeeEstimateHorizon horizon) {
     static const std::map<FeeEstimateHorizon, std::string> horizon_strings = {
         {FeeEstimateHorizon::SHORT_HALFLIFE, "short"},
@@ -71,9 +84,25 @@ private:
     std::vector<std::vector<int> > unconfTxs;  //unconfTxs[Y][X]
     // transactions still unconfirmed after GetMaxConfirms for each bucket
     std::vector<int> oldUnconfTxs;
+    // unconfSums[Y][X] is the sum of unconfTxs over all confirmation values
+    // from Y up to GetMaxConfirms, as seen from unconfSumsHeight
+    std::vector<std::vector<int> > unconfSums;
+    unsigned int unconfSumsHeight = 0;
+
+    // Whether EstimateMedianVal logs its calculation
+    bool logEstimates = true;
 
     void resizeInMemoryCounters(size_t newbuckets);
 
+    /** Whether unconfSums hold the sums seen from nBlockHeight. The circular
+     *  buffer must not wrap below height 0 for the sums to be kept. */
+    bool UnconfSumsValid(unsigned int nBlockHeight) const
+    {
+        return nBlockHeight == unconfSumsHeight && unconfSumsHeight + 1 >= unconfTxs.size();
+    }
+    /** Apply a change of unconfTxs[blockIndex][bucketindex] to unconfSums */
+    void UpdateUnconfSums(unsigned int blockIndex, unsigned int bucketindex, int delta);
+
 public:
     /**
      * Create new TxConfirmStats. This is called by BlockPolicyEstimator's
@@ -125,6 +154,8 @@ public:
     /** Return the max number of confirms we're tracking */
     unsigned int GetMaxConfirms() const { return scale * confAvg.size(); }
 
+    void SetLogEstimates(bool log) { logEstimates = log; }
+
     /** Write state of estimation data to a file*/
     void Write(CAutoFile& fileout) const;
 
@@ -162,8 +193,10 @@ TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
 void TxConfirmStats::resizeInMemoryCounters(size_t newbuckets) {
     // newbuckets must be passed in because the buckets referred to during Read have not been updated yet.
     unconfTxs.resize(GetMaxConfirms());
+    unconfSums.resize(GetMaxConfirms());
     for (unsigned int i = 0; i < unconfTxs.size(); i++) {
         unconfTxs[i].resize(newbuckets);
+        unconfSums[i].resize(newbuckets);
     }
     oldUnconfTxs.resize(newbuckets);
 }
@@ -175,6 +208,29 @@ void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
         oldUnconfTxs[j] += unconfTxs[nBlockHeight%unconfTxs.size()][j];
         unconfTxs[nBlockHeight%unconfTxs.size()][j] = 0;
     }
+
+    // Recompute the sums as seen from the new height
+    unconfSumsHeight = nBlockHeight;
+    if (!UnconfSumsValid(nBlockHeight)) return;
+    unsigned int bins = unconfTxs.size();
+    for (unsigned int j = 0; j < buckets.size(); j++) {
+        int sum = 0;
+        for (unsigned int confct = bins; confct-- > 0;) {
+            sum += unconfTxs[(nBlockHeight - confct) % bins][j];
+            unconfSums[confct][j] = sum;
+        }
+    }
+}
+
+void TxConfirmStats::UpdateUnconfSums(unsigned int blockIndex, unsigned int bucketindex, int delta)
+{
+    if (!UnconfSumsValid(unconfSumsHeight)) return;
+    // The confirmation value blockIndex stands for, seen from unconfSumsHeight
+    unsigned int bins = unconfTxs.size();
+    unsigned int confct = (unconfSumsHeight % bins + bins - blockIndex) % bins;
+    for (unsigned int i = 0; i <= confct; i++) {
+        unconfSums[i][bucketindex] += delta;
+    }
 }
 
 
@@ -237,6 +293,7 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
 
     bool foundAnswer = false;
     unsigned int bins = unconfTxs.size();
+    bool useSums = UnconfSumsValid(nBlockHeight);
     bool newBucketRange = true;
     bool passing = true;
     EstimatorBucket passBucket;
@@ -252,8 +309,12 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
         nConf += confAvg[periodTarget - 1][bucket];
         totalNum += txCtAvg[bucket];
         failNum += failAvg[periodTarget - 1][bucket];
-        for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
-            extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
+        if (useSums) {
+            if ((unsigned int)confTarget < bins) extraNum += unconfSums[confTarget][bucket];
+        } else {
+            for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
+                extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
+        }
         extraNum += oldUnconfTxs[bucket];
         // If we have enough transaction data points in this range of buckets,
         // we can test for success
@@ -338,7 +399,7 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
         failBucket.leftMempool = failNum;
     }
 
-    LogPrint(BCLog::ESTIMATEFEE, "FeeEst: %d %s%.0f%% decay %.5f: feerate: %g from (%g - %g) %.2f%% %.1f/(%.1f %d mem %.1f out) Fail: (%g - %g) %.2f%% %.1f/(%.1f %d mem %.1f out)\n",
+    if (logEstimates) LogPrint(BCLog::ESTIMATEFEE, "FeeEst: %d %s%.0f%% decay %.5f: feerate: %g from (%g - %g) %.2f%% %.1f/(%.1f %d mem %.1f out) Fail: (%g - %g) %.2f%% %.1f/(%.1f %d mem %.1f out)\n",
              confTarget, requireGreater ? ">" : "<", 100.0 * successBreakPoint, decay,
              median, passBucket.start, passBucket.end,
              100 * passBucket.withinTarget / (passBucket.totalConfirmed + passBucket.inMempool + passBucket.leftMempool),
@@ -428,6 +489,7 @@ unsigned int TxConfirmStats::NewTx(unsigned int nBlockHeight, double val)
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
     unsigned int blockIndex = nBlockHeight % unconfTxs.size();
     unconfTxs[blockIndex][bucketindex]++;
+    UpdateUnconfSums(blockIndex, bucketindex, 1);
     return bucketindex;
 }
 
@@ -454,6 +516,7 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         unsigned int blockIndex = entryHeight % unconfTxs.size();
         if (unconfTxs[blockIndex][bucketindex] > 0) {
             unconfTxs[blockIndex][bucketindex]--;
+            UpdateUnconfSums(blockIndex, bucketindex, -1);
         } else {
             LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error, mempool tx removed from blockIndex=%u,bucketIndex=%u already\n",
                      blockIndex, bucketindex);
@@ -478,6 +541,11 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
     LOCK(m_cs_fee_estimator);
     std::map<uint256, TxStatsInfo>::iterator pos = mapMemPoolTxs.find(hash);
     if (pos != mapMemPoolTxs.end()) {
+        // As in processTransaction, a transaction leaving at the height it
+        // entered only changes counts no estimate looks at.
+        if (pos->second.blockHeight != nBestSeenHeight || nBestSeenHeight + 1 < longStats->GetMaxConfirms()) {
+            InvalidateSmartFeeTable();
+        }
         feeStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         shortStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         longStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
@@ -547,6 +615,11 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, boo
     assert(bucketIndex == bucketIndex2);
     unsigned int bucketIndex3 = longStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
     assert(bucketIndex == bucketIndex3);
+
+    // A transaction entering at our best height is only counted for a
+    // confirmation target of 0, so estimates stay the same. That does not
+    // hold while the unconfirmed circular buffers can wrap below height 0.
+    if (txHeight + 1 < longStats->GetMaxConfirms()) InvalidateSmartFeeTable();
 }
 
 bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry)
@@ -623,6 +696,8 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
 
     trackedTxs = 0;
     untrackedTxs = 0;
+
+    BuildSmartFeeTable();
 }
 
 CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget) const
@@ -783,9 +858,70 @@ double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget,
  * longer time horizons also.
  */
 CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
+{
+    const std::shared_ptr<const SmartFeeTable> table = std::atomic_load(&m_smart_fee_table);
+    if (!table) return estimateSmartFeeUncached(confTarget, feeCalc, conservative);
+
+    if (feeCalc) {
+        feeCalc->desiredTarget = confTarget;
+        feeCalc->returnedTarget = confTarget;
+    }
+    if (confTarget <= 0 || (unsigned int)confTarget > table->maxTarget) {
+        return CFeeRate(0);  // error condition
+    }
+
+    const std::vector<SmartFeeTable::Entry>& entries = conservative ? table->conservative : table->economical;
+    const SmartFeeTable::Entry& entry = entries[std::min<size_t>(confTarget, entries.size() - 1)];
+    if (feeCalc) {
+        feeCalc->returnedTarget = entry.calc.returnedTarget;
+        // Error returns before any estimate was made leave these untouched
+        if (entry.calc.reason != FeeReason::NONE) {
+            feeCalc->est = entry.calc.est;
+            feeCalc->reason = entry.calc.reason;
+        }
+    }
+    return entry.feerate;
+}
+
+CFeeRate CBlockPolicyEstimator::estimateSmartFeeUncached(int confTarget, FeeCalculation *feeCalc, bool conservative) const
 {
     LOCK(m_cs_fee_estimator);
+    return estimateSmartFeeInternal(confTarget, feeCalc, conservative);
+}
+
+void CBlockPolicyEstimator::BuildSmartFeeTable()
+{
+    std::shared_ptr<SmartFeeTable> table = std::make_shared<SmartFeeTable>();
+    table->maxTarget = longStats->GetMaxConfirms();
+    // Targets above MaxUsableEstimate() are answered at MaxUsableEstimate()
+    // and a target of 1 at 2, so these entries cover every distinct answer.
+    unsigned int lastTarget = std::max(MaxUsableEstimate(), 2u);
+    table->economical.resize(lastTarget + 1);
+    table->conservative.resize(lastTarget + 1);
+
+    feeStats->SetLogEstimates(false);
+    shortStats->SetLogEstimates(false);
+    longStats->SetLogEstimates(false);
+    for (unsigned int target = 1; target <= lastTarget; target++) {
+        SmartFeeTable::Entry& economical = table->economical[target];
+        economical.feerate = estimateSmartFeeInternal(target, &economical.calc, false);
+        SmartFeeTable::Entry& conservative = table->conservative[target];
+        conservative.feerate = estimateSmartFeeInternal(target, &conservative.calc, true);
+    }
+    feeStats->SetLogEstimates(true);
+    shortStats->SetLogEstimates(true);
+    longStats->SetLogEstimates(true);
 
+    std::atomic_store(&m_smart_fee_table, std::shared_ptr<const SmartFeeTable>(std::move(table)));
+}
+
+void CBlockPolicyEstimator::InvalidateSmartFeeTable()
+{
+    std::atomic_store(&m_smart_fee_table, std::shared_ptr<const SmartFeeTable>());
+}
+
+CFeeRate CBlockPolicyEstimator::estimateSmartFeeInternal(int confTarget, FeeCalculation *feeCalc, bool conservative) const
+{
     if (feeCalc) {
         feeCalc->desiredTarget = confTarget;
         feeCalc->returnedTarget = confTarget;
@@ -937,6 +1073,7 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             nBestSeenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
             historicalBest = nFileHistoricalBest;
+            InvalidateSmartFeeTable();
         }
     }
     catch (const std::exception& e) {
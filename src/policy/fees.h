@@ -201,9 +201,14 @@ public:
      *  blocks. If no answer can be given at confTarget, return an estimate at
      *  the closest target where one can be given.  'conservative' estimates are
      *  valid over longer time horizons also.
+     *  The estimates for all targets are computed once per block and read
+     *  without taking the estimator lock.
      */
     CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
 
+    /** Same as estimateSmartFee, but always computed from the tracked data */
+    CFeeRate estimateSmartFeeUncached(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
+
     /** Return a specific fee estimate calculation with a given success
      * threshold and time horizon, and optionally return detailed data about
      * calculation
@@ -251,6 +256,17 @@ private:
     std::vector<double> buckets GUARDED_BY(m_cs_fee_estimator); // The upper-bound of the range for the bucket (inclusive)
     std::map<double, unsigned int> bucketMap GUARDED_BY(m_cs_fee_estimator); // Map of bucket upper-bound to index into all vectors by bucket
 
+    /** estimateSmartFee answers for every target */
+    struct SmartFeeTable;
+    /** Built at the end of processBlock, and reset to null whenever the
+     *  tracked data changes in a way that may change an estimate. Only
+     *  accessed through std::atomic_load and std::atomic_store. */
+    std::shared_ptr<const SmartFeeTable> m_smart_fee_table;
+
+    void BuildSmartFeeTable() EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    void InvalidateSmartFeeTable();
+    CFeeRate estimateSmartFeeInternal(int confTarget, FeeCalculation *feeCalc, bool conservative) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+
     /** Process a transaction confirmed in a block*/
     bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
 
@@ -94,7 +94,15 @@ public:
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action) {
         READWRITEAS(CBlockHeader, *this);
-        READWRITE(vtx);
+        if (ser_action.ForRead()) {
+            // Deserialize all transactions before hashing any of them, so
+            // the hashes can be computed in parallel lanes.
+            std::vector<CMutableTransaction> txs;
+            READWRITE(txs);
+            vtx = MakeTransactionRefs(std::move(txs));
+        } else {
+            READWRITE(vtx);
+        }
     }
 
     void SetNull()
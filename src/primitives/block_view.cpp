@@ -0,0 +1,165 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <primitives/block_view.h>
+
+#include <consensus/merkle.h>
+#include <hash.h>
+#include <streams.h>
+#include <version.h>
+
+#include <algorithm>
+#include <ios>
+
+namespace {
+
+/** Read a length-prefixed byte string as a span into the reader's data. */
+Span<const unsigned char> TakeVarBytes(SpanReader& s)
+{
+    return s.take(ReadCompactSize(s));
+}
+
+/** Bound a reservation by what the remaining bytes could possibly encode, so
+ *  that a bogus count can not make us allocate more than the input size. */
+size_t ReserveBound(uint64_t count, const SpanReader& s, size_t min_item_size)
+{
+    return std::min<uint64_t>(count, s.size() / min_item_size);
+}
+
+void ParseInputs(SpanReader& s, uint64_t count, std::vector<TxInView>& vin)
+{
+    // 36-byte outpoint, script length, nSequence
+    vin.reserve(ReserveBound(count, s, 41));
+    for (uint64_t i = 0; i < count; ++i) {
+        TxInView in;
+        s >> in.prevout;
+        in.scriptSig = TakeVarBytes(s);
+        s >> in.nSequence;
+        vin.push_back(in);
+    }
+}
+
+void ParseOutputs(SpanReader& s, std::vector<TxOutView>& vout)
+{
+    const uint64_t count = ReadCompactSize(s);
+    // 8-byte amount, script length
+    vout.reserve(ReserveBound(count, s, 9));
+    for (uint64_t i = 0; i < count; ++i) {
+        TxOutView out;
+        s >> out.nValue;
+        out.scriptPubKey = TakeVarBytes(s);
+        vout.push_back(out);
+    }
+}
+
+} // namespace
+
+uint256 TxView::ComputeHash() const
+{
+    if (!HasWitness()) return ComputeWitnessHash();
+    uint256 hash;
+    CHash256()
+        .Write(m_raw.data(), 4)
+        .Write(m_raw.data() + m_body_begin, m_body_end - m_body_begin)
+        .Write(m_raw.data() + m_raw.size() - 4, 4)
+        .Finalize(hash.begin());
+    return hash;
+}
+
+uint256 TxView::ComputeWitnessHash() const
+{
+    uint256 hash;
+    CHash256().Write(m_raw.data(), m_raw.size()).Finalize(hash.begin());
+    return hash;
+}
+
+CTransactionRef TxView::ToTransaction() const
+{
+    SpanReader s(SER_NETWORK, PROTOCOL_VERSION, m_raw);
+    return std::make_shared<const CTransaction>(deserialize, s);
+}
+
+/** Mirrors UnserializeTransaction() with witnesses allowed, including its
+ *  handling of the dummy vin and its rejection of unknown or superfluous
+ *  optional data. */
+void BlockView::ParseTransaction(SpanReader& s, Span<const unsigned char> block, TxView& tx)
+{
+    const size_t begin = s.pos();
+    s >> tx.nVersion;
+    tx.m_body_begin = s.pos() - begin;
+    unsigned char flags = 0;
+    uint64_t count = ReadCompactSize(s);
+    ParseInputs(s, count, tx.vin);
+    if (tx.vin.empty()) {
+        /* We read a dummy or an empty vin. */
+        s >> flags;
+        if (flags != 0) {
+            tx.m_body_begin = s.pos() - begin;
+            count = ReadCompactSize(s);
+            ParseInputs(s, count, tx.vin);
+            ParseOutputs(s, tx.vout);
+        }
+    } else {
+        ParseOutputs(s, tx.vout);
+    }
+    tx.m_body_end = s.pos() - begin;
+    if (flags & 1) {
+        flags ^= 1;
+        bool has_witness = false;
+        tx.m_witness_offsets.reserve(tx.vin.size() + 1);
+        tx.m_witness_offsets.push_back(0);
+        for (size_t i = 0; i < tx.vin.size(); ++i) {
+            const uint64_t items = ReadCompactSize(s);
+            for (uint64_t j = 0; j < items; ++j) {
+                tx.m_witness_items.push_back(TakeVarBytes(s));
+            }
+            has_witness |= items != 0;
+            tx.m_witness_offsets.push_back(tx.m_witness_items.size());
+        }
+        if (!has_witness) {
+            /* It's illegal to encode witnesses when all witness stacks are empty. */
+            throw std::ios_base::failure("Superfluous witness record");
+        }
+    }
+    if (flags) {
+        /* Unknown flag in the serialization */
+        throw std::ios_base::failure("Unknown transaction optional data");
+    }
+    s >> tx.nLockTime;
+    tx.m_raw = block.subspan(begin, s.pos() - begin);
+}
+
+BlockView::BlockView(Span<const unsigned char> data) : m_raw(data)
+{
+    SpanReader s(SER_NETWORK, PROTOCOL_VERSION, data);
+    s >> m_header;
+    const uint64_t count = ReadCompactSize(s);
+    // Smallest possible transaction: version, empty vin and vout, nLockTime.
+    m_txs.reserve(ReserveBound(count, s, 10));
+    for (uint64_t i = 0; i < count; ++i) {
+        m_txs.emplace_back();
+        ParseTransaction(s, data, m_txs.back());
+    }
+    if (!s.empty()) {
+        throw std::ios_base::failure("BlockView: trailing data after block");
+    }
+}
+
+uint256 BlockView::ComputeMerkleRoot(bool* mutated) const
+{
+    std::vector<uint256> leaves;
+    leaves.resize(m_txs.size());
+    for (size_t s = 0; s < m_txs.size(); s++) {
+        leaves[s] = m_txs[s].ComputeHash();
+    }
+    return ::ComputeMerkleRoot(std::move(leaves), mutated);
+}
+
+CBlock BlockView::ToBlock() const
+{
+    CBlock block;
+    SpanReader s(SER_NETWORK, PROTOCOL_VERSION, m_raw);
+    s >> block;
+    return block;
+}
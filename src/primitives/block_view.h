@@ -0,0 +1,143 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PRIMITIVES_BLOCK_VIEW_H
+#define BITCOIN_PRIMITIVES_BLOCK_VIEW_H
+
+#include <amount.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <serialize.h>
+#include <span.h>
+#include <uint256.h>
+
+#include <stdint.h>
+#include <vector>
+
+class SpanReader;
+
+/** One input of a TxView. scriptSig points into the buffer the view was parsed from. */
+struct TxInView
+{
+    COutPoint prevout;
+    Span<const unsigned char> scriptSig;
+    uint32_t nSequence;
+};
+
+/** One output of a TxView. scriptPubKey points into the buffer the view was parsed from. */
+struct TxOutView
+{
+    CAmount nValue;
+    Span<const unsigned char> scriptPubKey;
+
+    CTxOut ToTxOut() const { return CTxOut(nValue, CScript(scriptPubKey.begin(), scriptPubKey.end())); }
+};
+
+/**
+ * Read-only view of a transaction in (witness) serialization format, parsed in
+ * place. No script or witness data is copied; everything refers back to the
+ * buffer passed to the owning BlockView, which must outlive the view.
+ */
+class TxView
+{
+public:
+    int32_t nVersion;
+    uint32_t nLockTime;
+    std::vector<TxInView> vin;
+    std::vector<TxOutView> vout;
+
+    /** Witness stack of input nIn, empty if it has none. */
+    Span<const Span<const unsigned char>> Witness(size_t nIn) const
+    {
+        if (m_witness_offsets.empty()) return {};
+        return Span<const Span<const unsigned char>>(m_witness_items.data() + m_witness_offsets[nIn], m_witness_items.data() + m_witness_offsets[nIn + 1]);
+    }
+
+    bool HasWitness() const { return !m_witness_offsets.empty(); }
+    bool IsCoinBase() const { return vin.size() == 1 && vin[0].prevout.IsNull(); }
+
+    /** The exact bytes this transaction was parsed from. */
+    Span<const unsigned char> Raw() const { return m_raw; }
+    size_t GetTotalSize() const { return m_raw.size(); }
+    size_t GetStrippedSize() const { return HasWitness() ? 8 + (m_body_end - m_body_begin) : m_raw.size(); }
+
+    /** Hash the transaction. Unlike CTransaction these are not cached. */
+    uint256 ComputeHash() const;
+    uint256 ComputeWitnessHash() const;
+
+    /** Deserialize into a full CTransaction, for callers that need one. */
+    CTransactionRef ToTransaction() const;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        if (!HasWitness() || !(s.GetVersion() & SERIALIZE_TRANSACTION_NO_WITNESS)) {
+            s.write((const char*)m_raw.data(), m_raw.size());
+            return;
+        }
+        s.write((const char*)m_raw.data(), 4);
+        s.write((const char*)m_raw.data() + m_body_begin, m_body_end - m_body_begin);
+        s.write((const char*)m_raw.data() + m_raw.size() - 4, 4);
+    }
+
+private:
+    friend class BlockView;
+
+    Span<const unsigned char> m_raw;
+    /** [m_body_begin, m_body_end) is the vin and vout serialization; together
+     *  with the version and nLockTime it forms the non-witness encoding. */
+    size_t m_body_begin;
+    size_t m_body_end;
+    /** All witness items of the transaction; input i owns the items in
+     *  [m_witness_offsets[i], m_witness_offsets[i + 1]). Empty without witness. */
+    std::vector<Span<const unsigned char>> m_witness_items;
+    std::vector<uint32_t> m_witness_offsets;
+};
+
+/**
+ * Read-only view of a serialized block that does not allocate per script or
+ * witness item. Suited for paths that only read a block (serving it, indexing,
+ * hashing); use ToBlock() where a CBlock is needed. The underlying buffer must
+ * outlive the view and must not be modified while it is in use.
+ */
+class BlockView
+{
+public:
+    /** Parse data as a block in witness serialization format. Throws
+     *  std::ios_base::failure on malformed input or trailing data. */
+    explicit BlockView(Span<const unsigned char> data);
+
+    const CBlockHeader& GetHeader() const { return m_header; }
+    uint256 GetHash() const { return m_header.GetHash(); }
+    const std::vector<TxView>& Transactions() const { return m_txs; }
+    Span<const unsigned char> Raw() const { return m_raw; }
+
+    /** Same result as BlockMerkleRoot() on the equivalent CBlock. */
+    uint256 ComputeMerkleRoot(bool* mutated = nullptr) const;
+
+    CBlock ToBlock() const;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        if (!(s.GetVersion() & SERIALIZE_TRANSACTION_NO_WITNESS)) {
+            s.write((const char*)m_raw.data(), m_raw.size());
+            return;
+        }
+        s << m_header;
+        WriteCompactSize(s, m_txs.size());
+        for (const TxView& tx : m_txs) {
+            tx.Serialize(s);
+        }
+    }
+
+private:
+    static void ParseTransaction(SpanReader& s, Span<const unsigned char> block, TxView& tx);
+
+    Span<const unsigned char> m_raw;
+    CBlockHeader m_header;
+    std::vector<TxView> m_txs;
+};
+
+#endif // BITCOIN_PRIMITIVES_BLOCK_VIEW_H
@@ -5,7 +5,9 @@
 
 #include <primitives/transaction.h>
 #include <core_io.h>
+#include <crypto/sha256.h>
 #include <hash.h>
+#include <streams.h>
 #include <tinyformat.h>
 #include <util/strencodings.h>
 #include <script/standard.h>
@@ -82,6 +84,47 @@ uint256 CTransaction::ComputeWitnessHash() const
 CTransaction::CTransaction() : vin(), vout(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), hash{}, m_witness_hash{} {}
 CTransaction::CTransaction(const CMutableTransaction& tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
 CTransaction::CTransaction(CMutableTransaction&& tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
+CTransaction::CTransaction(CMutableTransaction&& tx, const uint256& hash_in, const uint256& witness_hash_in) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{hash_in}, m_witness_hash{witness_hash_in} {}
+
+std::vector<CTransactionRef> MakeTransactionRefs(std::vector<CMutableTransaction>&& txs)
+{
+    // Serialize every transaction, and separately the witness serialization of
+    // those that have one, into a single buffer so all hashes are computed in
+    // one SHA256DMulti call.
+    std::vector<unsigned char> buffer;
+    std::vector<size_t> offsets;
+    std::vector<size_t> witness_index(txs.size());
+    offsets.reserve(txs.size() + 1);
+    for (const CMutableTransaction& tx : txs) {
+        offsets.push_back(buffer.size());
+        CVectorWriter(SER_GETHASH, SERIALIZE_TRANSACTION_NO_WITNESS, buffer, buffer.size(), tx);
+    }
+    for (size_t i = 0; i < txs.size(); ++i) {
+        witness_index[i] = i;
+        if (txs[i].HasWitness()) {
+            witness_index[i] = offsets.size();
+            offsets.push_back(buffer.size());
+            CVectorWriter(SER_GETHASH, 0, buffer, buffer.size(), txs[i]);
+        }
+    }
+
+    const size_t count = offsets.size();
+    std::vector<const unsigned char*> inputs(count);
+    std::vector<size_t> lengths(count);
+    for (size_t i = 0; i < count; ++i) {
+        inputs[i] = buffer.data() + offsets[i];
+        lengths[i] = (i + 1 < count ? offsets[i + 1] : buffer.size()) - offsets[i];
+    }
+    std::vector<uint256> hashes(count);
+    SHA256DMulti(hashes.data()->begin(), inputs.data(), lengths.data(), count);
+
+    std::vector<CTransactionRef> ret;
+    ret.reserve(txs.size());
+    for (size_t i = 0; i < txs.size(); ++i) {
+        ret.emplace_back(new CTransaction(std::move(txs[i]), hashes[i], hashes[witness_index[i]]));
+    }
+    return ret;
+}
 
 CAmount CTransaction::GetValueOut() const
 {
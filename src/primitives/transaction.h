@@ -298,6 +298,10 @@ private:
     uint256 ComputeHash() const;
     uint256 ComputeWitnessHash() const;
 
+    /** Convert a CMutableTransaction whose hashes are already known. */
+    CTransaction(CMutableTransaction&& tx, const uint256& hash_in, const uint256& witness_hash_in);
+    friend std::vector<std::shared_ptr<const CTransaction>> MakeTransactionRefs(std::vector<CMutableTransaction>&& txs);
+
 public:
     /** Construct a CTransaction that qualifies as IsNull() */
     CTransaction();
@@ -414,4 +418,8 @@ typedef std::shared_ptr<const CTransaction> CTransactionRef;
 static inline CTransactionRef MakeTransactionRef() { return std::make_shared<const CTransaction>(); }
 template <typename Tx> static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::make_shared<const CTransaction>(std::forward<Tx>(txIn)); }
 
+/** Convert a batch of transactions, e.g. all transactions of a block, hashing
+ *  them together with the multi-way SHA256 implementations. */
+std::vector<CTransactionRef> MakeTransactionRefs(std::vector<CMutableTransaction>&& txs);
+
 #endif // BITCOIN_PRIMITIVES_TRANSACTION_H
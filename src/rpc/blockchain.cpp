@@ -19,7 +19,7 @@
 #include <node/utxo_snapshot.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
-#include <policy/rbf.h>
+#include <primitives/block_view.h>
 #include <primitives/transaction.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
@@ -403,37 +403,33 @@ static std::vector<RPCResult> MempoolEntryDescription() { return {
     RPCResult{RPCResult::Type::BOOL, "bip125-replaceable", "Whether this transaction could be replaced due to BIP125 (replace-by-fee)"},
 };}
 
-static void entryToJSON(const CTxMemPool& pool, UniValue& info, const CTxMemPoolEntry& e) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
+static void entryToJSON(UniValue& info, const MempoolSnapshot::Entry& e)
 {
-    AssertLockHeld(pool.cs);
-
     UniValue fees(UniValue::VOBJ);
-    fees.pushKV("base", ValueFromAmount(e.GetFee()));
-    fees.pushKV("modified", ValueFromAmount(e.GetModifiedFee()));
-    fees.pushKV("ancestor", ValueFromAmount(e.GetModFeesWithAncestors()));
-    fees.pushKV("descendant", ValueFromAmount(e.GetModFeesWithDescendants()));
+    fees.pushKV("base", ValueFromAmount(e.fee));
+    fees.pushKV("modified", ValueFromAmount(e.modified_fee));
+    fees.pushKV("ancestor", ValueFromAmount(e.mod_fees_with_ancestors));
+    fees.pushKV("descendant", ValueFromAmount(e.mod_fees_with_descendants));
     info.pushKV("fees", fees);
 
-    info.pushKV("vsize", (int)e.GetTxSize());
-    if (IsDeprecatedRPCEnabled("size")) info.pushKV("size", (int)e.GetTxSize());
-    info.pushKV("weight", (int)e.GetTxWeight());
-    info.pushKV("fee", ValueFromAmount(e.GetFee()));
-    info.pushKV("modifiedfee", ValueFromAmount(e.GetModifiedFee()));
-    info.pushKV("time", count_seconds(e.GetTime()));
-    info.pushKV("height", (int)e.GetHeight());
-    info.pushKV("descendantcount", e.GetCountWithDescendants());
-    info.pushKV("descendantsize", e.GetSizeWithDescendants());
-    info.pushKV("descendantfees", e.GetModFeesWithDescendants());
-    info.pushKV("ancestorcount", e.GetCountWithAncestors());
-    info.pushKV("ancestorsize", e.GetSizeWithAncestors());
-    info.pushKV("ancestorfees", e.GetModFeesWithAncestors());
-    info.pushKV("wtxid", pool.vTxHashes[e.vTxHashesIdx].first.ToString());
-    const CTransaction& tx = e.GetTx();
+    info.pushKV("vsize", (int)e.vsize);
+    if (IsDeprecatedRPCEnabled("size")) info.pushKV("size", (int)e.vsize);
+    info.pushKV("weight", (int)e.weight);
+    info.pushKV("fee", ValueFromAmount(e.fee));
+    info.pushKV("modifiedfee", ValueFromAmount(e.modified_fee));
+    info.pushKV("time", count_seconds(e.time));
+    info.pushKV("height", (int)e.height);
+    info.pushKV("descendantcount", e.count_with_descendants);
+    info.pushKV("descendantsize", e.size_with_descendants);
+    info.pushKV("descendantfees", e.mod_fees_with_descendants);
+    info.pushKV("ancestorcount", e.count_with_ancestors);
+    info.pushKV("ancestorsize", e.size_with_ancestors);
+    info.pushKV("ancestorfees", e.mod_fees_with_ancestors);
+    info.pushKV("wtxid", e.wtxid.ToString());
     std::set<std::string> setDepends;
-    for (const CTxIn& txin : tx.vin)
+    for (const uint256& parent : e.parents)
     {
-        if (pool.exists(txin.prevout.hash))
-            setDepends.insert(txin.prevout.hash.ToString());
+        setDepends.insert(parent.ToString());
     }
 
     UniValue depends(UniValue::VARR);
@@ -445,51 +441,62 @@ static void entryToJSON(const CTxMemPool& pool, UniValue& info, const CTxMemPool
     info.pushKV("depends", depends);
 
     UniValue spent(UniValue::VARR);
-    const CTxMemPool::txiter& it = pool.mapTx.find(tx.GetHash());
-    const CTxMemPool::setEntries& setChildren = pool.GetMemPoolChildren(it);
-    for (CTxMemPool::txiter childiter : setChildren) {
-        spent.push_back(childiter->GetTx().GetHash().ToString());
+    for (const uint256& child : e.children) {
+        spent.push_back(child.ToString());
     }
 
     info.pushKV("spentby", spent);
 
-    // Add opt-in RBF status
-    bool rbfStatus = false;
-    RBFTransactionState rbfState = IsRBFOptIn(tx, pool);
-    if (rbfState == RBFTransactionState::UNKNOWN) {
-        throw JSONRPCError(RPC_MISC_ERROR, "Transaction is not in mempool");
-    } else if (rbfState == RBFTransactionState::REPLACEABLE_BIP125) {
-        rbfStatus = true;
-    }
-
-    info.pushKV("bip125-replaceable", rbfStatus);
+    info.pushKV("bip125-replaceable", e.bip125_replaceable);
 }
 
-UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose)
+UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose, bool include_mempool_sequence)
 {
+    // Built from a snapshot, so the mempool is not locked while we go through it
+    const std::shared_ptr<const MempoolSnapshot> snapshot = pool.GetSnapshot();
     if (verbose) {
-        LOCK(pool.cs);
+        if (include_mempool_sequence) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbose results cannot contain mempool sequence values.");
+        }
         UniValue o(UniValue::VOBJ);
-        for (const CTxMemPoolEntry& e : pool.mapTx) {
-            const uint256& hash = e.GetTx().GetHash();
+        for (const MempoolSnapshot::Entry& e : snapshot->entries) {
             UniValue info(UniValue::VOBJ);
-            entryToJSON(pool, info, e);
+            entryToJSON(info, e);
             // Mempool has unique entries so there is no advantage in using
             // UniValue::pushKV, which checks if the key already exists in O(N).
             // UniValue::__pushKV is used instead which currently is O(1).
-            o.__pushKV(hash.ToString(), info);
+            o.__pushKV(e.txid.ToString(), info);
         }
         return o;
     } else {
-        std::vector<uint256> vtxid;
-        pool.queryHashes(vtxid);
-
         UniValue a(UniValue::VARR);
-        for (const uint256& hash : vtxid)
-            a.push_back(hash.ToString());
+        for (const MempoolSnapshot::Entry& e : snapshot->entries)
+            a.push_back(e.txid.ToString());
+
+        if (!include_mempool_sequence) {
+            return a;
+        } else {
+            UniValue o(UniValue::VOBJ);
+            o.pushKV("txids", a);
+            o.pushKV("mempool_sequence", snapshot->event_sequence);
+            return o;
+        }
+    }
+}
 
-        return a;
+/** Txids of the in-mempool ancestors (or descendants) of an entry in snapshot */
+static std::set<uint256> CalculateRelatives(const MempoolSnapshot& snapshot, const MempoolSnapshot::Entry& entry, bool ancestors)
+{
+    std::set<uint256> relatives;
+    std::vector<const MempoolSnapshot::Entry*> stage{&entry};
+    while (!stage.empty()) {
+        const MempoolSnapshot::Entry* e = stage.back();
+        stage.pop_back();
+        for (const uint256& txid : ancestors ? e->parents : e->children) {
+            if (relatives.insert(txid).second) stage.push_back(snapshot.Find(txid));
+        }
     }
+    return relatives;
 }
 
 static UniValue getrawmempool(const JSONRPCRequest& request)
@@ -499,6 +506,7 @@ static UniValue getrawmempool(const JSONRPCRequest& request)
                 "\nHint: use getmempoolentry to fetch a specific transaction from the mempool.\n",
                 {
                     {"verbose", RPCArg::Type::BOOL, /* default */ "false", "True for a json object, false for array of transaction ids"},
+                    {"mempool_sequence", RPCArg::Type::BOOL, /* default */ "false", "If verbose=false, returns a json object with transaction list and the mempool sequence number attached, see getmempoolevents."},
                 },
                 {
                     RPCResult{"for verbose = false",
@@ -511,6 +519,15 @@ static UniValue getrawmempool(const JSONRPCRequest& request)
                         {
                             {RPCResult::Type::OBJ_DYN, "transactionid", "", MempoolEntryDescription()},
                         }},
+                    RPCResult{"for verbose = false and mempool_sequence = true",
+                        RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::ARR, "txids", "",
+                            {
+                                {RPCResult::Type::STR_HEX, "", "The transaction id"},
+                            }},
+                            {RPCResult::Type::NUM, "mempool_sequence", "The sequence number of the first mempool event after this list was taken"},
+                        }},
                 },
                 RPCExamples{
                     HelpExampleCli("getrawmempool", "true")
@@ -522,7 +539,69 @@ static UniValue getrawmempool(const JSONRPCRequest& request)
     if (!request.params[0].isNull())
         fVerbose = request.params[0].get_bool();
 
-    return MempoolToJSON(EnsureMemPool(), fVerbose);
+    bool include_mempool_sequence = false;
+    if (!request.params[1].isNull()) {
+        include_mempool_sequence = request.params[1].get_bool();
+    }
+
+    return MempoolToJSON(EnsureMemPool(), fVerbose, include_mempool_sequence);
+}
+
+static UniValue getmempoolevents(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getmempoolevents",
+                "\nReturns the mempool events from a sequence number on: transactions added and removed, and blocks connected and\n"
+                "disconnected. Replaying them keeps a copy of the mempool taken with getrawmempool(false, true) in sync, starting\n"
+                "from its mempool_sequence. Only the last " + std::to_string(MEMPOOL_EVENT_LOG_SIZE) + " events are kept; if some\n"
+                "of the requested ones are gone, gap is set and the copy has to be taken again.\n",
+                {
+                    {"start_sequence", RPCArg::Type::NUM, RPCArg::Optional::NO, "The sequence number of the first event to return"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::NUM, "next_sequence", "The sequence number the next event will get"},
+                        {RPCResult::Type::BOOL, "gap", "Whether some events from start_sequence on are no longer kept"},
+                        {RPCResult::Type::ARR, "events", "",
+                        {
+                            {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::NUM, "sequence", "The event's sequence number"},
+                                {RPCResult::Type::STR, "type", "One of \"added\", \"removed\", \"blockconnected\", \"blockdisconnected\""},
+                                {RPCResult::Type::STR_HEX, "hash", "The transaction id, or the block hash for block events"},
+                                {RPCResult::Type::STR, "reason", /* optional */ true, "Why the transaction was removed, for removed events"},
+                            }},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getmempoolevents", "0")
+            + HelpExampleRpc("getmempoolevents", "0")
+                },
+            }.Check(request);
+
+    const int64_t start_sequence = request.params[0].get_int64();
+    if (start_sequence < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative start_sequence");
+    }
+
+    bool gap;
+    uint64_t next_sequence;
+    const std::vector<MempoolEvent> events = EnsureMemPool().GetEvents(start_sequence, gap, next_sequence);
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("next_sequence", next_sequence);
+    result.pushKV("gap", gap);
+    UniValue events_json(UniValue::VARR);
+    for (const MempoolEvent& event : events) {
+        UniValue event_json(UniValue::VOBJ);
+        event_json.pushKV("sequence", event.sequence);
+        event_json.pushKV("type", MempoolEventTypeToString(event.type));
+        event_json.pushKV("hash", event.hash.GetHex());
+        if (event.reason) event_json.pushKV("reason", RemovalReasonToString(*event.reason));
+        events_json.push_back(event_json);
+    }
+    result.pushKV("events", events_json);
+    return result;
 }
 
 static UniValue getmempoolancestors(const JSONRPCRequest& request)
@@ -552,34 +631,27 @@ static UniValue getmempoolancestors(const JSONRPCRequest& request)
 
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-    const CTxMemPool& mempool = EnsureMemPool();
-    LOCK(mempool.cs);
-
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
+    const std::shared_ptr<const MempoolSnapshot> snapshot = EnsureMemPool().GetSnapshot();
+    const MempoolSnapshot::Entry* entry = snapshot->Find(hash);
+    if (!entry) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
     }
 
-    CTxMemPool::setEntries setAncestors;
-    uint64_t noLimit = std::numeric_limits<uint64_t>::max();
-    std::string dummy;
-    mempool.CalculateMemPoolAncestors(*it, setAncestors, noLimit, noLimit, noLimit, noLimit, dummy, false);
+    const std::set<uint256> setAncestors = CalculateRelatives(*snapshot, *entry, /* ancestors */ true);
 
     if (!fVerbose) {
         UniValue o(UniValue::VARR);
-        for (CTxMemPool::txiter ancestorIt : setAncestors) {
-            o.push_back(ancestorIt->GetTx().GetHash().ToString());
+        for (const uint256& ancestor : setAncestors) {
+            o.push_back(ancestor.ToString());
         }
 
         return o;
     } else {
         UniValue o(UniValue::VOBJ);
-        for (CTxMemPool::txiter ancestorIt : setAncestors) {
-            const CTxMemPoolEntry &e = *ancestorIt;
-            const uint256& _hash = e.GetTx().GetHash();
+        for (const uint256& ancestor : setAncestors) {
             UniValue info(UniValue::VOBJ);
-            entryToJSON(mempool, info, e);
-            o.pushKV(_hash.ToString(), info);
+            entryToJSON(info, *snapshot->Find(ancestor));
+            o.pushKV(ancestor.ToString(), info);
         }
         return o;
     }
@@ -615,34 +687,27 @@ static UniValue getmempooldescendants(const JSONRPCRequest& request)
 
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-    const CTxMemPool& mempool = EnsureMemPool();
-    LOCK(mempool.cs);
-
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
+    const std::shared_ptr<const MempoolSnapshot> snapshot = EnsureMemPool().GetSnapshot();
+    const MempoolSnapshot::Entry* entry = snapshot->Find(hash);
+    if (!entry) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
     }
 
-    CTxMemPool::setEntries setDescendants;
-    mempool.CalculateDescendants(it, setDescendants);
-    // CTxMemPool::CalculateDescendants will include the given tx
-    setDescendants.erase(it);
+    const std::set<uint256> setDescendants = CalculateRelatives(*snapshot, *entry, /* ancestors */ false);
 
     if (!fVerbose) {
         UniValue o(UniValue::VARR);
-        for (CTxMemPool::txiter descendantIt : setDescendants) {
-            o.push_back(descendantIt->GetTx().GetHash().ToString());
+        for (const uint256& descendant : setDescendants) {
+            o.push_back(descendant.ToString());
         }
 
         return o;
     } else {
         UniValue o(UniValue::VOBJ);
-        for (CTxMemPool::txiter descendantIt : setDescendants) {
-            const CTxMemPoolEntry &e = *descendantIt;
-            const uint256& _hash = e.GetTx().GetHash();
+        for (const uint256& descendant : setDescendants) {
             UniValue info(UniValue::VOBJ);
-            entryToJSON(mempool, info, e);
-            o.pushKV(_hash.ToString(), info);
+            entryToJSON(info, *snapshot->Find(descendant));
+            o.pushKV(descendant.ToString(), info);
         }
         return o;
     }
@@ -665,17 +730,14 @@ static UniValue getmempoolentry(const JSONRPCRequest& request)
 
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-    const CTxMemPool& mempool = EnsureMemPool();
-    LOCK(mempool.cs);
-
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
+    const std::shared_ptr<const MempoolSnapshot> snapshot = EnsureMemPool().GetSnapshot();
+    const MempoolSnapshot::Entry* entry = snapshot->Find(hash);
+    if (!entry) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
     }
 
-    const CTxMemPoolEntry &e = *it;
     UniValue info(UniValue::VOBJ);
-    entryToJSON(mempool, info, e);
+    entryToJSON(info, *entry);
     return info;
 }
 
@@ -790,6 +852,24 @@ static CBlock GetBlockChecked(const CBlockIndex* pblockindex)
     return block;
 }
 
+bool SerializeBlockFromDisk(CDataStream& stream, const CBlockIndex* blockindex)
+{
+    std::vector<uint8_t> block_data;
+    if (!ReadRawBlockFromDisk(block_data, blockindex, Params().MessageStart())) {
+        return false;
+    }
+    try {
+        const BlockView block(Span<const uint8_t>(block_data.data(), block_data.size()));
+        if (block.GetHash() != blockindex->GetBlockHash()) {
+            return error("%s: GetHash() doesn't match index for %s", __func__, blockindex->ToString());
+        }
+        stream << block;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s for %s", __func__, e.what(), blockindex->ToString());
+    }
+    return true;
+}
+
 static CBlockUndo GetUndoChecked(const CBlockIndex* pblockindex)
 {
     CBlockUndo blockUndo;
@@ -894,15 +974,21 @@ static UniValue getblock(const JSONRPCRequest& request)
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
         }
 
-        block = GetBlockChecked(pblockindex);
-    }
+        if (verbosity <= 0)
+        {
+            // Serve the hex from the bytes on disk rather than deserializing
+            // the block only to serialize it again.
+            if (IsBlockPruned(pblockindex)) {
+                throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+            }
+            CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+            if (!SerializeBlockFromDisk(ssBlock, pblockindex)) {
+                throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+            }
+            return HexStr(ssBlock.begin(), ssBlock.end());
+        }
 
-    if (verbosity <= 0)
-    {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        block = GetBlockChecked(pblockindex);
     }
 
     return blockToJSON(block, tip, pblockindex, verbosity >= 2);
@@ -1392,16 +1478,27 @@ static UniValue getchaintips(const JSONRPCRequest& request)
 
 UniValue MempoolInfoToJSON(const CTxMemPool& pool)
 {
-    // Make sure this call is atomic in the pool.
-    LOCK(pool.cs);
-    UniValue ret(UniValue::VOBJ);
-    ret.pushKV("loaded", pool.IsLoaded());
-    ret.pushKV("size", (int64_t)pool.size());
-    ret.pushKV("bytes", (int64_t)pool.GetTotalTxSize());
-    ret.pushKV("usage", (int64_t)pool.DynamicMemoryUsage());
     size_t maxmempool = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    bool loaded;
+    int64_t size, bytes, usage;
+    CFeeRate min_fee;
+    {
+        // Make sure the values are consistent, but don't hold the pool
+        // while building the reply.
+        LOCK(pool.cs);
+        loaded = pool.IsLoaded();
+        size = pool.size();
+        bytes = pool.GetTotalTxSize();
+        usage = pool.DynamicMemoryUsage();
+        min_fee = pool.GetMinFee(maxmempool);
+    }
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("loaded", loaded);
+    ret.pushKV("size", size);
+    ret.pushKV("bytes", bytes);
+    ret.pushKV("usage", usage);
     ret.pushKV("maxmempool", (int64_t) maxmempool);
-    ret.pushKV("mempoolminfee", ValueFromAmount(std::max(pool.GetMinFee(maxmempool), ::minRelayTxFee).GetFeePerK()));
+    ret.pushKV("mempoolminfee", ValueFromAmount(std::max(min_fee, ::minRelayTxFee).GetFeePerK()));
     ret.pushKV("minrelaytxfee", ValueFromAmount(::minRelayTxFee.GetFeePerK()));
 
     return ret;
@@ -2371,8 +2468,9 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
+    { "blockchain",         "getmempoolevents",       &getmempoolevents,       {"start_sequence"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose", "mempool_sequence"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
@@ -11,10 +11,11 @@
 #include <stdint.h>
 #include <vector>
 
-extern RecursiveMutex cs_main;
+extern HoldTimedRecursiveMutex cs_main;
 
 class CBlock;
 class CBlockIndex;
+class CDataStream;
 class CTxMemPool;
 class UniValue;
 struct NodeContext;
@@ -39,11 +40,16 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIn
 UniValue MempoolInfoToJSON(const CTxMemPool& pool);
 
 /** Mempool to JSON */
-UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose = false);
+UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose = false, bool include_mempool_sequence = false);
 
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex) LOCKS_EXCLUDED(cs_main);
 
+/** Write a block to stream straight from its bytes on disk, without building a
+ *  CBlock. Witness data is stripped if the stream version asks for it. Returns
+ *  false if the block can not be read or does not match blockindex. */
+bool SerializeBlockFromDisk(CDataStream& stream, const CBlockIndex* blockindex);
+
 /** Used by getblockstats to get feerates at different percentiles by weight  */
 void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight);
 
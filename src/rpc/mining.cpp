@@ -364,6 +364,9 @@ static UniValue prioritisetransaction(const JSONRPCRequest& request)
     }
 
     EnsureMemPool().PrioritiseTransaction(hash, nAmount);
+    if (g_rpc_node->block_template_builder) {
+        g_rpc_node->block_template_builder->Reset();
+    }
     return true;
 }
 static UniValue blockToJSON(const CBlock& block)
@@ -741,7 +744,11 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
 
         // Create new block
         auto ticketTx = TryBuildTicketTx(wallet, pindexPrevNew->nHeight + 1);
-        pblocktemplate = BlockAssembler(mempool, Params()).CreateNewBlock(scriptReward, ticketTx);
+        if (g_rpc_node->block_template_builder) {
+            pblocktemplate = g_rpc_node->block_template_builder->CreateNewBlock(scriptReward, ticketTx);
+        } else {
+            pblocktemplate = BlockAssembler(mempool, Params()).CreateNewBlock(scriptReward, ticketTx);
+        }
         if (!pblocktemplate)
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
 
@@ -12,6 +12,7 @@
 #include <net_processing.h>
 #include <net_types.h> // For banmap_t
 #include <netbase.h>
+#include <netmetrics.h>
 #include <node/context.h>
 #include <policy/settings.h>
 #include <rpc/blockchain.h>
@@ -130,6 +131,14 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
                                                               "When a message type is not listed in this json object, the bytes received are 0.\n"
                                                               "Only known message types can appear as keys in the object and all bytes received of unknown message types are listed under '"+NET_MESSAGE_COMMAND_OTHER+"'."}
                             }},
+                            {RPCResult::Type::OBJ, "processtime_per_msg", "",
+                            {
+                                {RPCResult::Type::NUM, "msg", "The total time in seconds spent processing received messages, aggregated by message type\n"
+                                                              "When a message type is not listed in this json object, no time was spent on it.\n"
+                                                              "Time spent on unknown message types is listed under '"+NET_MESSAGE_COMMAND_OTHER+"'."}
+                            }},
+                            {RPCResult::Type::NUM, "last_block_announce_latency", "The time in seconds from the peer announcing the last block it announced before we had it to the block being connected (if any)"},
+                            {RPCResult::Type::NUM, "avg_block_announce_latency", "The average of last_block_announce_latency over all such blocks (if any)"},
                         }},
                     }},
                 },
@@ -218,12 +227,112 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
         }
         obj.pushKV("bytesrecv_per_msg", recvPerMsgCmd);
 
+        UniValue recvTimePerMsgCmd(UniValue::VOBJ);
+        for (const auto& i : stats.mapRecvTimePerMsgCmd) {
+            if (i.second > 0)
+                recvTimePerMsgCmd.pushKV(i.first, ((double)i.second) / 1e6);
+        }
+        obj.pushKV("processtime_per_msg", recvTimePerMsgCmd);
+        if (fStateStats) {
+            if (statestats.m_last_block_announce_latency >= 0) {
+                obj.pushKV("last_block_announce_latency", ((double)statestats.m_last_block_announce_latency) / 1e6);
+            }
+            if (statestats.m_avg_block_announce_latency >= 0) {
+                obj.pushKV("avg_block_announce_latency", ((double)statestats.m_avg_block_announce_latency) / 1e6);
+            }
+        }
+
         ret.push_back(obj);
     }
 
     return ret;
 }
 
+static std::vector<RPCResult> HistogramResult(const std::string& unit)
+{
+    return {
+        {RPCResult::Type::NUM, "count", "Number of values recorded"},
+        {RPCResult::Type::NUM, "sum", "Sum of the values recorded, in " + unit},
+        {RPCResult::Type::ARR, "buckets", "The buckets holding any values, in increasing order",
+        {
+            {RPCResult::Type::ARR_FIXED, "", "",
+            {
+                {RPCResult::Type::NUM, "", "The values in the bucket are below this many " + unit + ", null for the last bucket"},
+                {RPCResult::Type::NUM, "", "The number of values in the bucket"},
+            }},
+        }},
+    };
+}
+
+static UniValue HistogramToUniv(const LogHistogram& histogram)
+{
+    const LogHistogram::Snapshot snapshot = histogram.GetSnapshot();
+    UniValue buckets(UniValue::VARR);
+    for (int i = 0; i < LogHistogram::BUCKETS; ++i) {
+        if (snapshot.counts[i] == 0) continue;
+        UniValue bucket(UniValue::VARR);
+        bucket.push_back(i < LogHistogram::BUCKETS - 1 ? UniValue(LogHistogram::BucketLimit(i)) : NullUniValue);
+        bucket.push_back(snapshot.counts[i]);
+        buckets.push_back(bucket);
+    }
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("count", snapshot.count);
+    obj.pushKV("sum", snapshot.sum);
+    obj.pushKV("buckets", buckets);
+    return obj;
+}
+
+static UniValue PerMessageTypeToUniv(const NetMetrics::PerMessageType& map)
+{
+    UniValue obj(UniValue::VOBJ);
+    for (const auto& entry : map) {
+        if (entry.second.GetSnapshot().count == 0) continue;
+        obj.pushKV(entry.first, HistogramToUniv(entry.second));
+    }
+    return obj;
+}
+
+static UniValue getnetmetrics(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getnetmetrics",
+                "\nReturns histograms of the time spent handling P2P messages and sockets, since startup.\n"
+                "Each value recorded is counted in the bucket of values below the next power of two.\n"
+                "The same metrics are served in the Prometheus format at /metrics when -metrics is set.\n",
+                {},
+                RPCResult{
+                   RPCResult::Type::OBJ, "", "",
+                   {
+                       {RPCResult::Type::OBJ_DYN, "message_process", "Time spent processing a received message",
+                       {
+                           {RPCResult::Type::OBJ, "msg", "By message type, for the types received", HistogramResult("microseconds")},
+                       }},
+                       {RPCResult::Type::OBJ_DYN, "cs_main_hold", "Time cs_main was held while processing a received message",
+                       {
+                           {RPCResult::Type::OBJ, "msg", "By message type, and under '" + NetMetrics::SEND_MESSAGES + "' while sending messages", HistogramResult("microseconds")},
+                       }},
+                       {RPCResult::Type::OBJ, "send_messages", "Time spent sending messages to a peer", HistogramResult("microseconds")},
+                       {RPCResult::Type::OBJ, "socket_handler", "Time spent handling ready sockets", HistogramResult("microseconds")},
+                       {RPCResult::Type::OBJ, "send_queue", "Bytes left in a peer's send queue after queueing a message", HistogramResult("bytes")},
+                       {RPCResult::Type::OBJ, "block_announce_to_connect", "Time from a block first being announced to it being connected", HistogramResult("microseconds")},
+                   }
+                },
+                RPCExamples{
+                    HelpExampleCli("getnetmetrics", "")
+            + HelpExampleRpc("getnetmetrics", "")
+                },
+            }.Check(request);
+
+    const NetMetrics& metrics = GetNetMetrics();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("message_process", PerMessageTypeToUniv(metrics.process_time));
+    obj.pushKV("cs_main_hold", PerMessageTypeToUniv(metrics.cs_main_hold_time));
+    obj.pushKV("send_messages", HistogramToUniv(metrics.send_messages_time));
+    obj.pushKV("socket_handler", HistogramToUniv(metrics.socket_handler_time));
+    obj.pushKV("send_queue", HistogramToUniv(metrics.send_queue_bytes));
+    obj.pushKV("block_announce_to_connect", HistogramToUniv(metrics.block_announce_to_connect_time));
+    return obj;
+}
+
 static UniValue addnode(const JSONRPCRequest& request)
 {
     std::string strCommand;
@@ -777,6 +886,7 @@ static const CRPCCommand commands[] =
     { "network",            "clearbanned",            &clearbanned,            {} },
     { "network",            "setnetworkactive",       &setnetworkactive,       {"state"} },
     { "network",            "getnodeaddresses",       &getnodeaddresses,       {"count"} },
+    { "network",            "getnetmetrics",          &getnetmetrics,          {} },
 };
 // clang-format on
 
@@ -855,6 +855,80 @@ static UniValue sendrawtransaction(const JSONRPCRequest& request)
     return tx->GetHash().GetHex();
 }
 
+static UniValue sendrawtransactions(const JSONRPCRequest& request)
+{
+    RPCHelpMan{"sendrawtransactions",
+                "\nSubmit raw transactions (serialized, hex-encoded) to local node and network, as one batch.\n"
+                "\nTransactions are submitted in the given order, so each may spend outputs of those before it.\n"
+                "Their scripts are verified in parallel, and the mempool is locked once for the whole batch,\n"
+                "which makes this faster than calling sendrawtransaction for each of them.\n"
+                "\nTransactions accepted, or already in the mempool, are relayed to all peers as with sendrawtransaction.\n",
+                {
+                    {"rawtxs", RPCArg::Type::ARR, RPCArg::Optional::NO, "An array of hex strings of raw transactions.",
+                        {
+                            {"rawtx", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, ""},
+                        },
+                    },
+                    {"maxfeerate", RPCArg::Type::AMOUNT, /* default */ FormatMoney(DEFAULT_MAX_RAW_TX_FEE_RATE.GetFeePerK()),
+                        "Reject transactions whose fee rate is higher than the specified value, expressed in " + CURRENCY_UNIT +
+                            "/kB.\nSet to 0 to accept any fee rate.\n"},
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "The result for each transaction, in the order of rawtxs",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::STR_HEX, "txid", "The transaction hash in hex"},
+                            {RPCResult::Type::BOOL, "accepted", "If the transaction is in the mempool"},
+                            {RPCResult::Type::STR, "reject-reason", "Why the transaction was not accepted (only present when 'accepted' is false)"},
+                        }},
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("sendrawtransactions", "\"[\\\"signedhex1\\\", \\\"signedhex2\\\"]\"") +
+                    HelpExampleRpc("sendrawtransactions", "[\"signedhex1\", \"signedhex2\"]")
+                },
+    }.Check(request);
+
+    RPCTypeCheck(request.params, {
+        UniValue::VARR,
+        UniValueType(), // VNUM or VSTR, checked inside AmountFromValue()
+    });
+
+    const UniValue& rawtxs = request.params[0].get_array();
+    std::vector<CTransactionRef> txs;
+    txs.reserve(rawtxs.size());
+    for (size_t i = 0; i < rawtxs.size(); ++i) {
+        CMutableTransaction mtx;
+        if (!DecodeHexTx(mtx, rawtxs[i].get_str())) {
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for rawtxs[%u]", i));
+        }
+        txs.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    CFeeRate max_raw_tx_fee_rate = DEFAULT_MAX_RAW_TX_FEE_RATE;
+    if (!request.params[1].isNull()) {
+        max_raw_tx_fee_rate = CFeeRate(AmountFromValue(request.params[1]));
+    }
+
+    std::vector<TransactionError> errors;
+    std::vector<std::string> err_strings;
+    AssertLockNotHeld(cs_main);
+    BroadcastTransactions(*g_rpc_node, txs, errors, err_strings, max_raw_tx_fee_rate);
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < txs.size(); ++i) {
+        UniValue result_0(UniValue::VOBJ);
+        result_0.pushKV("txid", txs[i]->GetHash().GetHex());
+        result_0.pushKV("accepted", errors[i] == TransactionError::OK);
+        if (errors[i] != TransactionError::OK) {
+            result_0.pushKV("reject-reason", err_strings[i].empty() ? TransactionErrorString(errors[i]) : err_strings[i]);
+        }
+        result.push_back(std::move(result_0));
+    }
+    return result;
+}
+
 static UniValue testmempoolaccept(const JSONRPCRequest& request)
 {
     RPCHelpMan{"testmempoolaccept",
@@ -2231,6 +2305,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "decoderawtransaction",         &decoderawtransaction,      {"hexstring","iswitness"} },
     { "rawtransactions",    "decodescript",                 &decodescript,              {"hexstring"} },
     { "rawtransactions",    "sendrawtransaction",           &sendrawtransaction,        {"hexstring","allowhighfees|maxfeerate"} },
+    { "rawtransactions",    "sendrawtransactions",          &sendrawtransactions,       {"rawtxs","maxfeerate"} },
     { "rawtransactions",    "combinerawtransaction",        &combinerawtransaction,     {"txs"} },
     { "rawtransactions",    "signrawtransactionwithkey",    &signrawtransactionwithkey, {"hexstring","privkeys","prevtxs","sighashtype"} },
     { "rawtransactions",    "testmempoolaccept",            &testmempoolaccept,         {"rawtxs","allowhighfees|maxfeerate"} },
@@ -1535,6 +1535,150 @@ static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion,
     // There is intentionally no return statement here, to be able to use "control reaches end of non-void function" warnings to detect gaps in the logic above.
 }
 
+namespace {
+
+/** Size of the fixed suffix of a ticket redeem script, after the lock height push:
+ *  OP_CHECKLOCKTIMEVERIFY OP_DROP OP_DUP OP_HASH160 <20 bytes> OP_EQUALVERIFY OP_CHECKSIG */
+constexpr size_t TICKET_SCRIPT_SUFFIX_SIZE = 27;
+
+bool IsPayToPubKeyHash(const CScript& script)
+{
+    return script.size() == 25 &&
+           script[0] == OP_DUP &&
+           script[1] == OP_HASH160 &&
+           script[2] == 0x14 &&
+           script[23] == OP_EQUALVERIFY &&
+           script[24] == OP_CHECKSIG;
+}
+
+/** Check that data hashes (HASH160) to the 20 bytes at hash. */
+bool MatchHash160(const valtype& data, const unsigned char* hash)
+{
+    unsigned char sha[CSHA256::OUTPUT_SIZE];
+    unsigned char ripemd[CRIPEMD160::OUTPUT_SIZE];
+    CSHA256().Write(data.data(), data.size()).Finalize(sha);
+    CRIPEMD160().Write(sha, sizeof(sha)).Finalize(ripemd);
+    return memcmp(ripemd, hash, sizeof(ripemd)) == 0;
+}
+
+/** Read a single data push from script, applying the checks EvalScript does on pushes. */
+bool GetTemplatePush(const CScript& script, CScript::const_iterator& pc, valtype& data, unsigned int flags)
+{
+    opcodetype opcode;
+    if (!script.GetOp(pc, opcode, data) || opcode > OP_PUSHDATA4) return false;
+    if (data.size() > MAX_SCRIPT_ELEMENT_SIZE) return false;
+    if ((flags & SCRIPT_VERIFY_MINIMALDATA) && !CheckMinimalPush(data, opcode)) return false;
+    return true;
+}
+
+/** Equivalent of "<sig> <pubkey> OP_DUP OP_HASH160 <hash> OP_EQUALVERIFY OP_CHECKSIG" with script as scriptCode. */
+bool CheckTemplateSig(const valtype& vchSig, const valtype& vchPubKey, const unsigned char* hash, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion)
+{
+    if (!MatchHash160(vchPubKey, hash)) return false;
+
+    CScript scriptCode(script);
+    if (sigversion == SigVersion::BASE) {
+        int found = FindAndDelete(scriptCode, CScript() << vchSig);
+        if (found > 0 && (flags & SCRIPT_VERIFY_CONST_SCRIPTCODE)) return false;
+    }
+    if (!CheckSignatureEncoding(vchSig, flags, nullptr) || !CheckPubKeyEncoding(vchPubKey, flags, sigversion, nullptr)) {
+        return false;
+    }
+    return checker.CheckSig(vchSig, vchPubKey, scriptCode, sigversion);
+}
+
+/** Equivalent of "<locktime> OP_CHECKLOCKTIMEVERIFY OP_DROP" at the start of a ticket redeem script. */
+bool CheckTemplateLockTime(const CScript& redeemScript, CScript::const_iterator& pc, unsigned int flags, const BaseSignatureChecker& checker)
+{
+    opcodetype opcode;
+    valtype vchLockTime;
+    if (!redeemScript.GetOp(pc, opcode, vchLockTime)) return false;
+    if (opcode >= OP_1 && opcode <= OP_16) {
+        vchLockTime = CScriptNum(CScript::DecodeOP_N(opcode)).getvch();
+    } else if (opcode > OP_PUSHDATA4) {
+        return false;
+    } else if ((flags & SCRIPT_VERIFY_MINIMALDATA) && !CheckMinimalPush(vchLockTime, opcode)) {
+        return false;
+    }
+    if (vchLockTime.size() > 5) return false;
+
+    const CScriptNum nLockTime(vchLockTime, (flags & SCRIPT_VERIFY_MINIMALDATA) != 0, 5);
+    return nLockTime >= 0 && checker.CheckLockTime(nLockTime);
+}
+
+/**
+ * Fast path for the script templates that make up almost all spends on our chain:
+ * P2PKH, P2WPKH, and P2SH spends of the ticket redeem script (see GenerateTicketScript).
+ *
+ * Returns true only if the spend is known to be valid under flags. A false return
+ * means "not handled": the caller must run the generic interpreter, which then also
+ * determines the exact error. This keeps the fast path a pure optimization.
+ */
+bool VerifyTemplateScript(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness& witness, unsigned int flags, const BaseSignatureChecker& checker)
+{
+    if (scriptSig.size() > MAX_SCRIPT_SIZE) return false;
+
+    if (IsPayToPubKeyHash(scriptPubKey)) {
+        // <sig> <pubkey>
+        if ((flags & SCRIPT_VERIFY_WITNESS) && !witness.IsNull()) return false;
+        CScript::const_iterator pc = scriptSig.begin();
+        valtype vchSig, vchPubKey;
+        if (!GetTemplatePush(scriptSig, pc, vchSig, flags) || !GetTemplatePush(scriptSig, pc, vchPubKey, flags) || pc != scriptSig.end()) {
+            return false;
+        }
+        return CheckTemplateSig(vchSig, vchPubKey, scriptPubKey.data() + 3, scriptPubKey, flags, checker, SigVersion::BASE);
+    }
+
+    int witnessversion;
+    std::vector<unsigned char> witnessprogram;
+    if ((flags & SCRIPT_VERIFY_WITNESS) && scriptPubKey.IsWitnessProgram(witnessversion, witnessprogram)) {
+        // Witness: <sig> <pubkey>
+        if (witnessversion != 0 || witnessprogram.size() != WITNESS_V0_KEYHASH_SIZE) return false;
+        // An all-zero program leaves a false value on the stack after scriptPubKey evaluation.
+        if (!CastToBool(witnessprogram)) return false;
+        if (scriptSig.size() != 0 || witness.stack.size() != 2) return false;
+        const valtype& vchSig = witness.stack[0];
+        const valtype& vchPubKey = witness.stack[1];
+        if (vchSig.size() > MAX_SCRIPT_ELEMENT_SIZE || vchPubKey.size() > MAX_SCRIPT_ELEMENT_SIZE) return false;
+        CScript scriptCode;
+        scriptCode << OP_DUP << OP_HASH160 << witnessprogram << OP_EQUALVERIFY << OP_CHECKSIG;
+        return CheckTemplateSig(vchSig, vchPubKey, witnessprogram.data(), scriptCode, flags, checker, SigVersion::WITNESS_V0);
+    }
+
+    if ((flags & SCRIPT_VERIFY_P2SH) && scriptPubKey.IsPayToScriptHash()) {
+        // <sig> <pubkey> <redeemScript>, redeemScript being a ticket script.
+        // With CLTV disabled the interpreter treats OP_CHECKLOCKTIMEVERIFY as a NOP; leave that to it.
+        if (!(flags & SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY)) return false;
+        if ((flags & SCRIPT_VERIFY_WITNESS) && !witness.IsNull()) return false;
+        CScript::const_iterator pc = scriptSig.begin();
+        valtype vchSig, vchPubKey, vchRedeemScript;
+        if (!GetTemplatePush(scriptSig, pc, vchSig, flags) || !GetTemplatePush(scriptSig, pc, vchPubKey, flags) ||
+            !GetTemplatePush(scriptSig, pc, vchRedeemScript, flags) || pc != scriptSig.end()) {
+            return false;
+        }
+        if (!MatchHash160(vchRedeemScript, scriptPubKey.data() + 2)) return false;
+
+        const CScript redeemScript(vchRedeemScript.begin(), vchRedeemScript.end());
+        CScript::const_iterator rc = redeemScript.begin();
+        try {
+            if (!CheckTemplateLockTime(redeemScript, rc, flags, checker)) return false;
+        } catch (const scriptnum_error&) {
+            return false;
+        }
+        if (redeemScript.end() - rc != TICKET_SCRIPT_SUFFIX_SIZE) return false;
+        const unsigned char* suffix = &*rc;
+        if (suffix[0] != OP_CHECKLOCKTIMEVERIFY || suffix[1] != OP_DROP || suffix[2] != OP_DUP || suffix[3] != OP_HASH160 ||
+            suffix[4] != 0x14 || suffix[25] != OP_EQUALVERIFY || suffix[26] != OP_CHECKSIG) {
+            return false;
+        }
+        return CheckTemplateSig(vchSig, vchPubKey, suffix + 5, redeemScript, flags, checker, SigVersion::BASE);
+    }
+
+    return false;
+}
+
+} // namespace
+
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     static const CScriptWitness emptyWitness;
@@ -1549,6 +1693,12 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
         return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
     }
 
+    // Common templates are verified without running the interpreter. Anything
+    // the fast path does not accept, including every failure, falls through.
+    if (VerifyTemplateScript(scriptSig, scriptPubKey, *witness, flags, checker)) {
+        return set_success(serror);
+    }
+
     // scriptSig and scriptPubKey must be evaluated sequentially on the same stack
     // rather than being simply concatenated (see CVE-2010-5141)
     std::vector<std::vector<unsigned char> > stack, stackCopy;
@@ -7,6 +7,7 @@
 
 #include <pubkey.h>
 #include <random.h>
+#include <streams.h>
 #include <uint256.h>
 #include <util/system.h>
 
@@ -56,6 +57,33 @@ public:
     {
         return setValid.setup_bytes(n);
     }
+
+    template <typename Stream>
+    void Dump(Stream& s)
+    {
+        std::vector<uint256> entries;
+        {
+            boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+            setValid.for_each([&](const uint256& entry) { entries.push_back(entry); });
+        }
+        s << nonce << entries;
+    }
+
+    //! Entries are only meaningful under the nonce they were computed with,
+    //! so this replaces the nonce and must not be mixed with earlier entries.
+    template <typename Stream>
+    void Load(Stream& s)
+    {
+        uint256 saved_nonce;
+        std::vector<uint256> entries;
+        s >> saved_nonce >> entries;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonce = saved_nonce;
+        for (const uint256& entry : entries) {
+            setValid.insert(entry);
+        }
+    }
 };
 
 /* In previous versions of this code, signatureCache was a local static variable
@@ -79,6 +107,16 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+void DumpSignatureCache(CAutoFile& file)
+{
+    signatureCache.Dump(file);
+}
+
+void LoadSignatureCache(CAutoFile& file)
+{
+    signatureCache.Load(file);
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
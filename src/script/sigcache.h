@@ -17,6 +17,7 @@ static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
 
+class CAutoFile;
 class CPubKey;
 
 /**
@@ -53,4 +54,11 @@ public:
 
 void InitSignatureCache();
 
+/** Write the signature cache nonce and its entries to file. */
+void DumpSignatureCache(CAutoFile& file);
+
+/** Restore the signature cache nonce and entries from file. Must only be
+ * called on startup, before the cache is used. */
+void LoadSignatureCache(CAutoFile& file);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
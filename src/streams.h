@@ -8,6 +8,7 @@
 
 #include <support/allocators/zeroafterfree.h>
 #include <serialize.h>
+#include <span.h>
 
 #include <algorithm>
 #include <assert.h>
@@ -193,6 +194,64 @@ public:
     }
 };
 
+/** Minimal stream for reading from an existing byte span, without copying
+ *  it first. Also hands out sub-spans, for parsers that keep pointers into
+ *  the data rather than deserializing it.
+ */
+class SpanReader
+{
+private:
+    const int m_type;
+    const int m_version;
+    Span<const unsigned char> m_data;
+    size_t m_pos = 0;
+
+public:
+
+    /**
+     * @param[in]  type Serialization Type
+     * @param[in]  version Serialization Version (including any flags)
+     * @param[in]  data Referenced byte span to read from; must outlive the reader
+     */
+    SpanReader(int type, int version, Span<const unsigned char> data)
+        : m_type(type), m_version(version), m_data(data) {}
+
+    template<typename T>
+    SpanReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+
+    int GetVersion() const { return m_version; }
+    int GetType() const { return m_type; }
+
+    size_t size() const { return m_data.size() - m_pos; }
+    bool empty() const { return size() == 0; }
+    /** Number of bytes consumed so far. */
+    size_t pos() const { return m_pos; }
+
+    /** Consume n bytes and return them as a span into the underlying data. */
+    Span<const unsigned char> take(size_t n)
+    {
+        if (n > size()) {
+            throw std::ios_base::failure("SpanReader::take(): end of data");
+        }
+        Span<const unsigned char> ret = m_data.subspan(m_pos, n);
+        m_pos += n;
+        return ret;
+    }
+
+    void read(char* dst, size_t n)
+    {
+        if (n == 0) {
+            return;
+        }
+        memcpy(dst, take(n).data(), n);
+    }
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -0,0 +1,140 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUBNETTRIE_H
+#define BITCOIN_SUBNETTRIE_H
+
+#include <netaddress.h>
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+/**
+ * Map from subnets to values, answering which subnets match an address in time
+ * proportional to the address length rather than to the number of subnets.
+ *
+ * Subnets are kept in a binary trie over the 128 bits of their network address
+ * (IPv4 and Tor addresses are mapped into the IPv6 space by CNetAddr), with a
+ * value at the node of each prefix. Subnets whose netmask is not a prefix, or
+ * that are invalid, are kept aside and checked one by one; there are few of those.
+ *
+ * Erasing a subnet leaves its nodes in place; Clear() to reclaim them.
+ */
+template <typename T>
+class SubNetTrie
+{
+private:
+    struct Node {
+        //! Indexes of the children for a 0 and a 1 bit in m_nodes, or 0 for none
+        uint32_t child[2] = {0, 0};
+        bool has_value = false;
+        T value{};
+    };
+
+    //! The trie, with the root (the empty prefix) first
+    std::vector<Node> m_nodes;
+    //! Subnets that are not prefixes
+    std::vector<std::pair<CSubNet, T>> m_other;
+    size_t m_size = 0;
+
+    static int Bit(const CNetAddr& addr, int i)
+    {
+        return (addr.GetByte(15 - i / 8) >> (7 - i % 8)) & 1;
+    }
+
+public:
+    SubNetTrie() { Clear(); }
+
+    /** The value of sub_net, default constructed if it was not added before */
+    T& operator[](const CSubNet& sub_net)
+    {
+        const int prefix_length = sub_net.GetPrefixLength();
+        if (prefix_length < 0) {
+            for (auto& entry : m_other) {
+                if (entry.first == sub_net) return entry.second;
+            }
+            ++m_size;
+            m_other.emplace_back(sub_net, T{});
+            return m_other.back().second;
+        }
+        const CNetAddr& network = sub_net.GetNetwork();
+        uint32_t pos = 0;
+        for (int i = 0; i < prefix_length; ++i) {
+            const int bit = Bit(network, i);
+            if (m_nodes[pos].child[bit] == 0) {
+                m_nodes[pos].child[bit] = m_nodes.size();
+                m_nodes.emplace_back();
+            }
+            pos = m_nodes[pos].child[bit];
+        }
+        Node& node = m_nodes[pos];
+        if (!node.has_value) {
+            ++m_size;
+            node.has_value = true;
+            node.value = T{};
+        }
+        return node.value;
+    }
+
+    /** Remove sub_net. Returns whether it was there. */
+    bool Erase(const CSubNet& sub_net)
+    {
+        const int prefix_length = sub_net.GetPrefixLength();
+        if (prefix_length < 0) {
+            for (auto it = m_other.begin(); it != m_other.end(); ++it) {
+                if (it->first == sub_net) {
+                    m_other.erase(it);
+                    --m_size;
+                    return true;
+                }
+            }
+            return false;
+        }
+        const CNetAddr& network = sub_net.GetNetwork();
+        uint32_t pos = 0;
+        for (int i = 0; i < prefix_length; ++i) {
+            pos = m_nodes[pos].child[Bit(network, i)];
+            if (pos == 0) return false;
+        }
+        if (!m_nodes[pos].has_value) return false;
+        m_nodes[pos].has_value = false;
+        --m_size;
+        return true;
+    }
+
+    void Clear()
+    {
+        m_nodes.assign(1, Node{});
+        m_other.clear();
+        m_size = 0;
+    }
+
+    size_t Size() const { return m_size; }
+
+    /**
+     * Call fn with the value of every subnet matching addr, as CSubNet::Match
+     * does, broader prefixes first, until it returns true.
+     * @returns whether fn returned true
+     */
+    template <typename Fn>
+    bool ForEachMatch(const CNetAddr& addr, Fn fn) const
+    {
+        if (!addr.IsValid()) return false;
+        uint32_t pos = 0;
+        for (int i = 0;; ++i) {
+            const Node& node = m_nodes[pos];
+            if (node.has_value && fn(node.value)) return true;
+            if (i == 128) break;
+            pos = node.child[Bit(addr, i)];
+            if (pos == 0) break;
+        }
+        for (const auto& entry : m_other) {
+            if (entry.first.Match(addr) && fn(entry.second)) return true;
+        }
+        return false;
+    }
+};
+
+#endif // BITCOIN_SUBNETTRIE_H
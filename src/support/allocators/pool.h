@@ -0,0 +1,197 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <cassert>
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <vector>
+
+/**
+ * Memory resource for the nodes of node based containers (std::map, std::set,
+ * boost::multi_index_container), which allocate many blocks of the same few
+ * sizes one at a time.
+ *
+ * Blocks of up to MAX_BLOCK_SIZE_BYTES are carved out of large chunks, each
+ * rounded up to a multiple of ALIGN_BYTES, without the per allocation header
+ * and padding of malloc. A freed block goes on the free list of its size and
+ * is handed out again by the next allocation of that size; chunks are only
+ * released when the resource is destroyed. Larger blocks are passed through
+ * to operator new.
+ *
+ * Not thread safe: containers sharing a resource must be guarded by the same
+ * lock.
+ */
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+class PoolResource
+{
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    static_assert(ALIGN_BYTES > 0 && (ALIGN_BYTES & (ALIGN_BYTES - 1)) == 0, "ALIGN_BYTES must be a power of two");
+    static_assert(ALIGN_BYTES >= sizeof(FreeBlock) && ALIGN_BYTES % alignof(FreeBlock) == 0, "ALIGN_BYTES must fit a free list pointer");
+    static_assert(MAX_BLOCK_SIZE_BYTES % ALIGN_BYTES == 0, "MAX_BLOCK_SIZE_BYTES must be a multiple of ALIGN_BYTES");
+
+    const std::size_t m_chunk_size_bytes;
+    std::vector<char*> m_chunks;
+    //! Free blocks of each size, indexed by size in units of ALIGN_BYTES
+    FreeBlock* m_free_lists[MAX_BLOCK_SIZE_BYTES / ALIGN_BYTES + 1] = {};
+    //! Untouched rest of the last chunk
+    char* m_available_begin = nullptr;
+    char* m_available_end = nullptr;
+    std::size_t m_pooled_bytes = 0;
+    std::size_t m_unpooled_bytes = 0;
+
+    static std::size_t NumUnits(std::size_t bytes)
+    {
+        return bytes == 0 ? 1 : (bytes + ALIGN_BYTES - 1) / ALIGN_BYTES;
+    }
+
+    static bool IsPooled(std::size_t bytes, std::size_t alignment)
+    {
+        return bytes <= MAX_BLOCK_SIZE_BYTES && alignment <= ALIGN_BYTES;
+    }
+
+    void PushFree(void* p, std::size_t units)
+    {
+        FreeBlock* block = new (p) FreeBlock{m_free_lists[units]};
+        m_free_lists[units] = block;
+    }
+
+    void AllocateChunk()
+    {
+        // Hand out what is left of the current chunk as a smaller block later
+        // rather than losing it.
+        const std::size_t remaining = m_available_end - m_available_begin;
+        if (remaining > 0) PushFree(m_available_begin, remaining / ALIGN_BYTES);
+
+        m_chunks.push_back(static_cast<char*>(::operator new(m_chunk_size_bytes)));
+        m_available_begin = m_chunks.back();
+        m_available_end = m_available_begin + m_chunk_size_bytes;
+    }
+
+public:
+    static constexpr std::size_t DEFAULT_CHUNK_SIZE_BYTES = 256 * 1024;
+
+    explicit PoolResource(std::size_t chunk_size_bytes = DEFAULT_CHUNK_SIZE_BYTES)
+        : m_chunk_size_bytes(chunk_size_bytes / ALIGN_BYTES * ALIGN_BYTES)
+    {
+        assert(m_chunk_size_bytes >= MAX_BLOCK_SIZE_BYTES);
+    }
+
+    ~PoolResource()
+    {
+        for (char* chunk : m_chunks) {
+            ::operator delete(chunk);
+        }
+    }
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    void* Allocate(std::size_t bytes, std::size_t alignment)
+    {
+        if (!IsPooled(bytes, alignment)) {
+            void* p = ::operator new(bytes);
+            m_unpooled_bytes += bytes;
+            return p;
+        }
+        const std::size_t units = NumUnits(bytes);
+        m_pooled_bytes += units * ALIGN_BYTES;
+        if (FreeBlock* block = m_free_lists[units]) {
+            m_free_lists[units] = block->next;
+            return block;
+        }
+        if (static_cast<std::size_t>(m_available_end - m_available_begin) < units * ALIGN_BYTES) {
+            AllocateChunk();
+        }
+        void* p = m_available_begin;
+        m_available_begin += units * ALIGN_BYTES;
+        return p;
+    }
+
+    void Deallocate(void* p, std::size_t bytes, std::size_t alignment) noexcept
+    {
+        if (!IsPooled(bytes, alignment)) {
+            m_unpooled_bytes -= bytes;
+            ::operator delete(p);
+            return;
+        }
+        const std::size_t units = NumUnits(bytes);
+        m_pooled_bytes -= units * ALIGN_BYTES;
+        PushFree(p, units);
+    }
+
+    /** Bytes of the pooled blocks in use, at their rounded up size */
+    std::size_t PooledBytes() const { return m_pooled_bytes; }
+    /** Bytes of the blocks in use that were passed through to operator new */
+    std::size_t UnpooledBytes() const { return m_unpooled_bytes; }
+    /** Bytes of all chunks allocated so far */
+    std::size_t ChunkBytes() const { return m_chunks.size() * m_chunk_size_bytes; }
+};
+
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+constexpr std::size_t PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>::DEFAULT_CHUNK_SIZE_BYTES;
+
+/**
+ * Allocator handing out memory from a PoolResource, which must outlive it.
+ * Only single objects (the nodes) come from the resource: arrays, like the
+ * bucket arrays of hash tables, are allocated once and reallocated rarely, so
+ * they go to operator new and are not part of the resource's usage.
+ */
+template <typename T, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    PoolAllocator(ResourceType* resource) noexcept : m_resource(resource) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) noexcept : m_resource(other.resource())
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) throw std::bad_alloc();
+        if (n != 1) return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(m_resource->Allocate(sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        if (n != 1) return ::operator delete(p);
+        m_resource->Deallocate(p, sizeof(T), alignof(T));
+    }
+
+    ResourceType* resource() const noexcept { return m_resource; }
+
+private:
+    ResourceType* m_resource;
+};
+
+template <typename T, typename U, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator==(const PoolAllocator<T, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a, const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return a.resource() == b.resource();
+}
+
+template <typename T, typename U, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator!=(const PoolAllocator<T, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a, const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
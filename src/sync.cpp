@@ -13,6 +13,7 @@
 #include <util/strencodings.h>
 #include <util/threadnames.h>
 
+#include <chrono>
 #include <map>
 #include <set>
 #include <system_error>
@@ -28,6 +29,43 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+#ifdef HAVE_THREAD_LOCAL
+namespace {
+struct HoldTimes {
+    int depth{0};
+    int64_t start{0};
+    int64_t total{0};
+};
+thread_local HoldTimes g_hold_times;
+
+int64_t SteadyMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+} // namespace
+
+void HoldTimedRecursiveMutexBase::OnLocked()
+{
+    // Only the outermost lock of a recursive mutex starts a hold
+    if (g_hold_times.depth++ == 0) g_hold_times.start = SteadyMicros();
+}
+
+void HoldTimedRecursiveMutexBase::OnUnlock()
+{
+    if (--g_hold_times.depth == 0) g_hold_times.total += SteadyMicros() - g_hold_times.start;
+}
+
+int64_t HoldTimedRecursiveMutexBase::HeldMicros()
+{
+    if (g_hold_times.depth == 0) return g_hold_times.total;
+    return g_hold_times.total + SteadyMicros() - g_hold_times.start;
+}
+#else
+void HoldTimedRecursiveMutexBase::OnLocked() {}
+void HoldTimedRecursiveMutexBase::OnUnlock() {}
+int64_t HoldTimedRecursiveMutexBase::HeldMicros() { return 0; }
+#endif /* HAVE_THREAD_LOCAL */
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
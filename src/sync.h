@@ -112,6 +112,46 @@ using RecursiveMutex = AnnotatedMixin<std::recursive_mutex>;
 /** Wrapped mutex: supports waiting but not recursive locking */
 typedef AnnotatedMixin<std::mutex> Mutex;
 
+/**
+ * std::recursive_mutex that keeps count of how long the calling thread has held
+ * it, so that the time spent under a busy lock can be attributed to the code
+ * that took it. The count is per thread, not per mutex, so this is meant for a
+ * single global mutex (cs_main).
+ */
+class HoldTimedRecursiveMutexBase : public std::recursive_mutex
+{
+public:
+    void lock()
+    {
+        std::recursive_mutex::lock();
+        OnLocked();
+    }
+
+    void unlock()
+    {
+        OnUnlock();
+        std::recursive_mutex::unlock();
+    }
+
+    bool try_lock()
+    {
+        if (!std::recursive_mutex::try_lock()) return false;
+        OnLocked();
+        return true;
+    }
+
+    /** Microseconds the calling thread has held the mutex in total, including
+     *  the current hold if any. Always 0 without thread_local support. */
+    static int64_t HeldMicros();
+
+private:
+    static void OnLocked();
+    static void OnUnlock();
+};
+
+/** Wrapped recursive mutex, keeping count of how long each thread held it */
+using HoldTimedRecursiveMutex = AnnotatedMixin<HoldTimedRecursiveMutexBase>;
+
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
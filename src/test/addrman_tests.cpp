@@ -26,7 +26,7 @@ public:
             MakeDeterministic();
         }
         deterministic = makeDeterministic;
-        m_asmap = asmap;
+        m_asmap = Asmap(asmap);
     }
 
     //! Ensure that bucket placement is always the same for testing purposes.
@@ -460,7 +460,7 @@ BOOST_AUTO_TEST_CASE(caddrinfo_get_tried_bucket_legacy)
     uint256 nKey1 = (uint256)(CHashWriter(SER_GETHASH, 0) << 1).GetHash();
     uint256 nKey2 = (uint256)(CHashWriter(SER_GETHASH, 0) << 2).GetHash();
 
-    std::vector<bool> asmap; // use /16
+    Asmap asmap; // use /16
 
     BOOST_CHECK_EQUAL(info1.GetTriedBucket(nKey1, asmap), 40);
 
@@ -514,7 +514,7 @@ BOOST_AUTO_TEST_CASE(caddrinfo_get_new_bucket_legacy)
     uint256 nKey1 = (uint256)(CHashWriter(SER_GETHASH, 0) << 1).GetHash();
     uint256 nKey2 = (uint256)(CHashWriter(SER_GETHASH, 0) << 2).GetHash();
 
-    std::vector<bool> asmap; // use /16
+    Asmap asmap; // use /16
 
     // Test: Make sure the buckets are what we expect
     BOOST_CHECK_EQUAL(info1.GetNewBucket(nKey1, asmap), 786);
@@ -593,7 +593,7 @@ BOOST_AUTO_TEST_CASE(caddrinfo_get_tried_bucket)
     uint256 nKey1 = (uint256)(CHashWriter(SER_GETHASH, 0) << 1).GetHash();
     uint256 nKey2 = (uint256)(CHashWriter(SER_GETHASH, 0) << 2).GetHash();
 
-    std::vector<bool> asmap = FromBytes(asmap_raw, sizeof(asmap_raw) * 8);
+    Asmap asmap{FromBytes(asmap_raw, sizeof(asmap_raw) * 8)};
 
     BOOST_CHECK_EQUAL(info1.GetTriedBucket(nKey1, asmap), 236);
 
@@ -647,7 +647,7 @@ BOOST_AUTO_TEST_CASE(caddrinfo_get_new_bucket)
     uint256 nKey1 = (uint256)(CHashWriter(SER_GETHASH, 0) << 1).GetHash();
     uint256 nKey2 = (uint256)(CHashWriter(SER_GETHASH, 0) << 2).GetHash();
 
-    std::vector<bool> asmap = FromBytes(asmap_raw, sizeof(asmap_raw) * 8);
+    Asmap asmap{FromBytes(asmap_raw, sizeof(asmap_raw) * 8)};
 
     // Test: Make sure the buckets are what we expect
     BOOST_CHECK_EQUAL(info1.GetNewBucket(nKey1, asmap), 795);
@@ -713,6 +713,51 @@ BOOST_AUTO_TEST_CASE(caddrinfo_get_new_bucket)
 
 }
 
+static uint32_t InterpretBytes(const std::vector<bool>& asmap, const unsigned char (&ip)[16])
+{
+    std::vector<bool> ip_bits(128);
+    for (int i = 0; i < 128; ++i) {
+        ip_bits[i] = (ip[i / 8] >> (7 - i % 8)) & 1;
+    }
+    return Interpret(asmap, ip_bits);
+}
+
+BOOST_AUTO_TEST_CASE(asmap_lookup_table)
+{
+    std::vector<bool> bits = FromBytes(asmap_raw, sizeof(asmap_raw) * 8);
+    Asmap asmap(bits);
+    BOOST_CHECK(asmap.GetBits() == bits);
+    BOOST_CHECK(asmap.Size() > 0);
+
+    unsigned char ip[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 101, 3, 7, 9};
+    BOOST_CHECK_EQUAL(asmap.Lookup(ip), 3U);
+    ip[12] = 250;
+    BOOST_CHECK_EQUAL(asmap.Lookup(ip), 1000U);
+    BOOST_CHECK_EQUAL(ResolveIP("101.8.1.1").GetMappedAS(asmap), 8U);
+    BOOST_CHECK_EQUAL(ResolveIP("102.8.1.1").GetMappedAS(asmap), 0U);
+
+    // Random IPv4 and IPv6 addresses map the same way as with the interpreter.
+    for (int i = 0; i < 10000; ++i) {
+        for (int j = 0; j < 16; ++j) ip[j] = InsecureRandBits(8);
+        if (i % 2) {
+            memcpy(ip, "\0\0\0\0\0\0\0\0\0\0\xff\xff", 12);
+            if (i % 4 == 1) ip[12] = InsecureRandBool() ? 250 : 101;
+        }
+        BOOST_CHECK_EQUAL(asmap.Lookup(ip), InterpretBytes(bits, ip));
+    }
+
+    // So do random, mostly malformed, programs.
+    for (int i = 0; i < 2000; ++i) {
+        std::vector<bool> program(InsecureRandRange(400));
+        for (size_t j = 0; j < program.size(); ++j) program[j] = InsecureRandBool();
+        Asmap random_asmap(program);
+        for (int k = 0; k < 16; ++k) {
+            for (int j = 0; j < 16; ++j) ip[j] = InsecureRandBits(8);
+            BOOST_CHECK_EQUAL(random_asmap.Lookup(ip), InterpretBytes(program, ip));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(addrman_serialization)
 {
     std::vector<bool> asmap1 = FromBytes(asmap_raw, sizeof(asmap_raw) * 8);
@@ -0,0 +1,157 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <consensus/merkle.h>
+#include <primitives/block_view.h>
+#include <streams.h>
+#include <version.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(block_view_tests, BasicTestingSetup)
+
+static CBlock BuildBlockTestCase()
+{
+    CBlock block;
+    block.nVersion = 42;
+    block.hashPrevBlock = InsecureRand256();
+    block.nTime = 1234;
+    block.nBits = 0x207fffff;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << OP_1 << OP_2;
+    coinbase.vin[0].scriptWitness.stack.push_back(std::vector<unsigned char>(32, 0));
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50 * COIN;
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    CMutableTransaction legacy;
+    legacy.vin.resize(2);
+    for (CTxIn& in : legacy.vin) {
+        in.prevout = COutPoint(InsecureRand256(), InsecureRandBits(8));
+        in.scriptSig = CScript() << std::vector<unsigned char>(72, 1);
+        in.nSequence = InsecureRand32();
+    }
+    legacy.vout.resize(3);
+    for (CTxOut& out : legacy.vout) {
+        out.nValue = InsecureRandRange(COIN);
+        out.scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 2) << OP_EQUALVERIFY << OP_CHECKSIG;
+    }
+    legacy.nLockTime = 100;
+    block.vtx.push_back(MakeTransactionRef(legacy));
+
+    // Witness on the second input only, including an empty stack item.
+    CMutableTransaction segwit = legacy;
+    segwit.vin[0].scriptSig.clear();
+    segwit.vin[1].scriptSig.clear();
+    segwit.vin[1].scriptWitness.stack = {std::vector<unsigned char>(71, 3), {}, std::vector<unsigned char>(33, 4)};
+    block.vtx.push_back(MakeTransactionRef(segwit));
+
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
+}
+
+static std::vector<unsigned char> Serialize(const CBlock& block, int version = PROTOCOL_VERSION)
+{
+    CDataStream stream(SER_NETWORK, version);
+    stream << block;
+    return std::vector<unsigned char>(stream.begin(), stream.end());
+}
+
+BOOST_AUTO_TEST_CASE(block_view_matches_deserialized_block)
+{
+    const CBlock block = BuildBlockTestCase();
+    const std::vector<unsigned char> raw = Serialize(block);
+    const BlockView view(MakeSpan(raw));
+
+    BOOST_CHECK(view.GetHash() == block.GetHash());
+    BOOST_CHECK(view.Raw() == MakeSpan(raw));
+    BOOST_REQUIRE_EQUAL(view.Transactions().size(), block.vtx.size());
+
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        const CTransaction& tx = *block.vtx[i];
+        const TxView& txv = view.Transactions()[i];
+
+        BOOST_CHECK_EQUAL(txv.nVersion, tx.nVersion);
+        BOOST_CHECK_EQUAL(txv.nLockTime, tx.nLockTime);
+        BOOST_CHECK_EQUAL(txv.HasWitness(), tx.HasWitness());
+        BOOST_CHECK_EQUAL(txv.IsCoinBase(), tx.IsCoinBase());
+        BOOST_CHECK(txv.ComputeHash() == tx.GetHash());
+        BOOST_CHECK(txv.ComputeWitnessHash() == tx.GetWitnessHash());
+        BOOST_CHECK_EQUAL(txv.GetTotalSize(), tx.GetTotalSize());
+        BOOST_CHECK_EQUAL(txv.GetStrippedSize(), ::GetSerializeSize(tx, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS));
+
+        BOOST_REQUIRE_EQUAL(txv.vin.size(), tx.vin.size());
+        for (size_t j = 0; j < tx.vin.size(); ++j) {
+            BOOST_CHECK(txv.vin[j].prevout == tx.vin[j].prevout);
+            BOOST_CHECK(txv.vin[j].scriptSig == MakeSpan(tx.vin[j].scriptSig));
+            BOOST_CHECK_EQUAL(txv.vin[j].nSequence, tx.vin[j].nSequence);
+
+            const auto witness = txv.Witness(j);
+            const auto& stack = tx.vin[j].scriptWitness.stack;
+            BOOST_REQUIRE_EQUAL((size_t)witness.size(), stack.size());
+            for (size_t k = 0; k < stack.size(); ++k) {
+                BOOST_CHECK(witness[k] == MakeSpan(stack[k]));
+            }
+        }
+        BOOST_REQUIRE_EQUAL(txv.vout.size(), tx.vout.size());
+        for (size_t j = 0; j < tx.vout.size(); ++j) {
+            BOOST_CHECK(txv.vout[j].ToTxOut() == tx.vout[j]);
+        }
+        BOOST_CHECK(txv.ToTransaction()->GetWitnessHash() == tx.GetWitnessHash());
+    }
+
+    bool mutated = true;
+    BOOST_CHECK(view.ComputeMerkleRoot(&mutated) == block.hashMerkleRoot);
+    BOOST_CHECK(!mutated);
+    BOOST_CHECK(view.ToBlock().GetHash() == block.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(block_view_serialize)
+{
+    const CBlock block = BuildBlockTestCase();
+    const std::vector<unsigned char> raw = Serialize(block);
+    const BlockView view(MakeSpan(raw));
+
+    for (int version : {PROTOCOL_VERSION, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS}) {
+        CDataStream stream(SER_NETWORK, version);
+        stream << view;
+        BOOST_CHECK(std::vector<unsigned char>(stream.begin(), stream.end()) == Serialize(block, version));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(block_view_malformed)
+{
+    const CBlock block = BuildBlockTestCase();
+    std::vector<unsigned char> raw = Serialize(block);
+
+    // Every truncation must be rejected, never read past the end.
+    for (size_t len = 0; len < raw.size(); ++len) {
+        BOOST_CHECK_THROW(BlockView{Span<const unsigned char>(raw.data(), len)}, std::ios_base::failure);
+    }
+
+    raw.push_back(0);
+    BOOST_CHECK_THROW(BlockView{Span<const unsigned char>(raw.data(), raw.size())}, std::ios_base::failure);
+
+    // A witness marker with all witness stacks empty is rejected, as by CBlock.
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << CBlockHeader();
+    WriteCompactSize(stream, 1);
+    stream << tx.nVersion << (unsigned char)0 << (unsigned char)1 << tx.vin << tx.vout;
+    WriteCompactSize(stream, 0);
+    stream << tx.nLockTime;
+    const std::vector<unsigned char> superfluous(stream.begin(), stream.end());
+    CBlock deserialized;
+    BOOST_CHECK_THROW(stream >> deserialized, std::ios_base::failure);
+    BOOST_CHECK_THROW(BlockView{MakeSpan(superfluous)}, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
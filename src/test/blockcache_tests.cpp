@@ -0,0 +1,66 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockcache.h>
+#include <primitives/block.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcache_tests, BasicTestingSetup)
+
+static std::shared_ptr<const CBlock> MakeBlock(uint32_t nonce)
+{
+    auto block = std::make_shared<CBlock>();
+    block->nNonce = nonce;
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_lru)
+{
+    RecentBlockCache cache(2);
+    const auto block1 = MakeBlock(1);
+    const auto block2 = MakeBlock(2);
+    const auto block3 = MakeBlock(3);
+
+    BOOST_CHECK(!cache.GetBlock(block1->GetHash()));
+
+    cache.Add(block1);
+    cache.Add(block2);
+    BOOST_CHECK(cache.GetBlock(block1->GetHash()) == block1);
+    BOOST_CHECK(cache.GetBlock(block2->GetHash()) == block2);
+
+    // block1 was used less recently than block2, so it is evicted first.
+    cache.Add(block3);
+    BOOST_CHECK(!cache.GetBlock(block1->GetHash()));
+    BOOST_CHECK(cache.GetBlock(block2->GetHash()) == block2);
+    BOOST_CHECK(cache.GetBlock(block3->GetHash()) == block3);
+
+    cache.Clear();
+    BOOST_CHECK(!cache.GetBlock(block2->GetHash()));
+    BOOST_CHECK(!cache.GetBlock(block3->GetHash()));
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_serialized)
+{
+    RecentBlockCache cache(2);
+    const auto block = MakeBlock(1);
+    const auto data = std::make_shared<const std::vector<uint8_t>>(80, 0x42);
+
+    // Serialized data is only kept for cached blocks.
+    cache.AddSerialized(block->GetHash(), data);
+    BOOST_CHECK(!cache.GetSerialized(block->GetHash()));
+
+    cache.Add(block);
+    BOOST_CHECK(!cache.GetSerialized(block->GetHash()));
+    cache.AddSerialized(block->GetHash(), data);
+    BOOST_CHECK(cache.GetSerialized(block->GetHash()) == data);
+
+    // Re-adding the block keeps its serialized form.
+    cache.Add(block);
+    BOOST_CHECK(cache.GetSerialized(block->GetHash()) == data);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
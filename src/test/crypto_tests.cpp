@@ -750,4 +750,26 @@ BOOST_AUTO_TEST_CASE(sha256d64)
     }
 }
 
+BOOST_AUTO_TEST_CASE(sha256dmulti)
+{
+    for (int i = 0; i <= 40; ++i) {
+        // Messages of every length class relative to the 64-byte chunk and its padding.
+        std::vector<std::vector<unsigned char>> in(i);
+        std::vector<const unsigned char*> inputs(i);
+        std::vector<size_t> lengths(i);
+        for (int j = 0; j < i; ++j) {
+            in[j].resize(InsecureRandRange(300));
+            for (unsigned char& c : in[j]) c = InsecureRandBits(8);
+            inputs[j] = in[j].data();
+            lengths[j] = in[j].size();
+        }
+        std::vector<unsigned char> out1(32 * i), out2(32 * i);
+        for (int j = 0; j < i; ++j) {
+            CHash256().Write(in[j].data(), in[j].size()).Finalize(out1.data() + 32 * j);
+        }
+        SHA256DMulti(out2.data(), inputs.data(), lengths.data(), i);
+        BOOST_CHECK(out1 == out2);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 #include <random.h>
 #include <thread>
 #include <deque>
+#include <set>
 
 /** Test Suite for CuckooCache
  *
@@ -363,4 +364,36 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
 }
 
+BOOST_AUTO_TEST_CASE(cuckoocache_for_each)
+{
+    SeedInsecureRand(SeedRand::ZEROS);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup_bytes(1 << 20);
+    std::vector<uint256> hashes;
+    for (int x = 0; x < 1000; ++x) {
+        hashes.push_back(InsecureRand256());
+        cc.insert(hashes.back());
+    }
+    // Erased elements are not reported.
+    BOOST_CHECK(cc.contains(hashes[0], true));
+
+    std::set<uint256> seen;
+    cc.for_each([&](const uint256& e) { seen.insert(e); });
+    BOOST_CHECK_EQUAL(seen.size(), hashes.size() - 1);
+    BOOST_CHECK(!seen.count(hashes[0]));
+    for (size_t x = 1; x < hashes.size(); ++x) {
+        BOOST_CHECK(seen.count(hashes[x]));
+    }
+
+    // Reinserting the reported elements into a fresh cache restores it.
+    CuckooCache::cache<uint256, SignatureCacheHasher> restored{};
+    restored.setup_bytes(1 << 20);
+    for (const uint256& e : seen) {
+        restored.insert(e);
+    }
+    for (size_t x = 1; x < hashes.size(); ++x) {
+        BOOST_CHECK(restored.contains(hashes[x], false));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
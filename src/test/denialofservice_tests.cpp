@@ -12,6 +12,7 @@
 #include <script/signingprovider.h>
 #include <script/standard.h>
 #include <serialize.h>
+#include <txorphanage.h>
 #include <util/memory.h>
 #include <util/string.h>
 #include <util/system.h>
@@ -42,18 +43,8 @@ struct CConnmanTest : public CConnman {
 };
 
 // Tests these internal-to-net_processing.cpp methods:
-extern bool AddOrphanTx(const CTransactionRef& tx, NodeId peer);
-extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
 extern void Misbehaving(NodeId nodeid, int howmuch, const std::string& message="");
 
-struct COrphanTx {
-    CTransactionRef tx;
-    NodeId fromPeer;
-    int64_t nTimeExpire;
-};
-extern std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
-
 static CService ip(uint32_t i)
 {
     struct in_addr s;
@@ -350,14 +341,28 @@ BOOST_AUTO_TEST_CASE(DoS_bantime)
     peerLogic->FinalizeNode(dummyNode.GetId(), dummy);
 }
 
-static CTransactionRef RandomOrphan()
+class TxOrphanageTest : public TxOrphanage
 {
-    std::map<uint256, COrphanTx>::iterator it;
-    LOCK2(cs_main, g_cs_orphans);
-    it = mapOrphanTransactions.lower_bound(InsecureRand256());
-    if (it == mapOrphanTransactions.end())
-        it = mapOrphanTransactions.begin();
-    return it->second.tx;
+public:
+    CTransactionRef RandomOrphan() EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
+    {
+        auto it = m_orphans.begin();
+        std::advance(it, InsecureRandRange(m_orphans.size()));
+        return it->second.tx;
+    }
+};
+
+static CMutableTransaction OrphanSpending(const uint256& prev_hash, const CKey& key)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.n = 0;
+    tx.vin[0].prevout.hash = prev_hash;
+    tx.vin[0].scriptSig << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1*CENT;
+    tx.vout[0].scriptPubKey = GetScriptForDestination(PKHash(key.GetPubKey()));
+    return tx;
 }
 
 BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
@@ -367,25 +372,19 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     FillableSigningProvider keystore;
     BOOST_CHECK(keystore.AddKey(key));
 
+    TxOrphanageTest orphanage;
+    LOCK(g_cs_orphans);
+
     // 50 orphan transactions:
     for (int i = 0; i < 50; i++)
     {
-        CMutableTransaction tx;
-        tx.vin.resize(1);
-        tx.vin[0].prevout.n = 0;
-        tx.vin[0].prevout.hash = InsecureRand256();
-        tx.vin[0].scriptSig << OP_1;
-        tx.vout.resize(1);
-        tx.vout[0].nValue = 1*CENT;
-        tx.vout[0].scriptPubKey = GetScriptForDestination(PKHash(key.GetPubKey()));
-
-        AddOrphanTx(MakeTransactionRef(tx), i);
+        orphanage.AddTx(MakeTransactionRef(OrphanSpending(InsecureRand256(), key)), i);
     }
 
     // ... and 50 that depend on other orphans:
     for (int i = 0; i < 50; i++)
     {
-        CTransactionRef txPrev = RandomOrphan();
+        CTransactionRef txPrev = orphanage.RandomOrphan();
 
         CMutableTransaction tx;
         tx.vin.resize(1);
@@ -396,13 +395,13 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         tx.vout[0].scriptPubKey = GetScriptForDestination(PKHash(key.GetPubKey()));
         BOOST_CHECK(SignSignature(keystore, *txPrev, tx, 0, SIGHASH_ALL));
 
-        AddOrphanTx(MakeTransactionRef(tx), i);
+        orphanage.AddTx(MakeTransactionRef(tx), i);
     }
 
     // This really-big orphan should be ignored:
     for (int i = 0; i < 10; i++)
     {
-        CTransactionRef txPrev = RandomOrphan();
+        CTransactionRef txPrev = orphanage.RandomOrphan();
 
         CMutableTransaction tx;
         tx.vout.resize(1);
@@ -420,25 +419,87 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         for (unsigned int j = 1; j < tx.vin.size(); j++)
             tx.vin[j].scriptSig = tx.vin[0].scriptSig;
 
-        BOOST_CHECK(!AddOrphanTx(MakeTransactionRef(tx), i));
+        BOOST_CHECK(!orphanage.AddTx(MakeTransactionRef(tx), i));
     }
 
-    LOCK2(cs_main, g_cs_orphans);
-    // Test EraseOrphansFor:
+    // Test EraseForPeer:
     for (NodeId i = 0; i < 3; i++)
     {
-        size_t sizeBefore = mapOrphanTransactions.size();
-        EraseOrphansFor(i);
-        BOOST_CHECK(mapOrphanTransactions.size() < sizeBefore);
-    }
-
-    // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
-    BOOST_CHECK(mapOrphanTransactions.empty());
+        size_t sizeBefore = orphanage.Size();
+        orphanage.EraseForPeer(i);
+        BOOST_CHECK(orphanage.Size() < sizeBefore);
+        BOOST_CHECK_EQUAL(orphanage.PeerBytes(i), 0U);
+    }
+
+    // Test LimitOrphans:
+    orphanage.LimitOrphans(40, std::numeric_limits<size_t>::max());
+    BOOST_CHECK(orphanage.Size() <= 40);
+    orphanage.LimitOrphans(10, std::numeric_limits<size_t>::max());
+    BOOST_CHECK(orphanage.Size() <= 10);
+    orphanage.LimitOrphans(0, std::numeric_limits<size_t>::max());
+    BOOST_CHECK_EQUAL(orphanage.Size(), 0U);
+    BOOST_CHECK_EQUAL(orphanage.TotalBytes(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_orphanage_limits)
+{
+    CKey key;
+    key.MakeNewKey(true);
+
+    TxOrphanage orphanage;
+    LOCK(g_cs_orphans);
+
+    // Peer 0 floods us, peers 1 and 2 send a few orphans each.
+    std::vector<CTransactionRef> flood, honest;
+    for (int i = 0; i < 40; i++) {
+        flood.push_back(MakeTransactionRef(OrphanSpending(InsecureRand256(), key)));
+        BOOST_CHECK(orphanage.AddTx(flood.back(), 0));
+    }
+    for (int i = 0; i < 6; i++) {
+        honest.push_back(MakeTransactionRef(OrphanSpending(InsecureRand256(), key)));
+        BOOST_CHECK(orphanage.AddTx(honest.back(), 1 + i % 2));
+    }
+    BOOST_CHECK(!orphanage.AddTx(honest.back(), 1));
+    BOOST_CHECK_EQUAL(orphanage.TotalBytes(), orphanage.PeerBytes(0) + orphanage.PeerBytes(1) + orphanage.PeerBytes(2));
+
+    // Going over either limit evicts from the peer that uses the most.
+    orphanage.LimitOrphans(20, std::numeric_limits<size_t>::max());
+    BOOST_CHECK_EQUAL(orphanage.Size(), 20U);
+    orphanage.LimitOrphans(20, orphanage.TotalBytes() / 2);
+    BOOST_CHECK(orphanage.Size() < 20);
+    for (const CTransactionRef& tx : honest) {
+        BOOST_CHECK(orphanage.HaveTx(tx->GetHash()));
+    }
+    BOOST_CHECK_EQUAL(orphanage.TotalBytes(), orphanage.PeerBytes(0) + orphanage.PeerBytes(1) + orphanage.PeerBytes(2));
+
+    // The children of a transaction are found through the outpoint index.
+    CMutableTransaction parent = OrphanSpending(InsecureRand256(), key);
+    parent.vout.resize(2, parent.vout[0]);
+    CTransactionRef child0 = MakeTransactionRef(OrphanSpending(parent.GetHash(), key));
+    CMutableTransaction child1 = OrphanSpending(parent.GetHash(), key);
+    child1.vin[0].prevout.n = 1;
+    child1.vin.push_back(child1.vin[0]);
+    BOOST_CHECK(orphanage.AddTx(child0, 3));
+    BOOST_CHECK(orphanage.AddTx(MakeTransactionRef(child1), 3));
+    std::set<uint256> work_set;
+    orphanage.AddChildrenToWorkSet(CTransaction(parent), work_set);
+    BOOST_CHECK(work_set == std::set<uint256>({child0->GetHash(), child1.GetHash()}));
+
+    NodeId from_peer = -1;
+    BOOST_CHECK(orphanage.GetTx(child0->GetHash(), from_peer) == child0);
+    BOOST_CHECK_EQUAL(from_peer, 3);
+    BOOST_CHECK_EQUAL(orphanage.EraseTx(child1.GetHash()), 1);
+    BOOST_CHECK_EQUAL(orphanage.EraseTx(child1.GetHash()), 0);
+    work_set.clear();
+    orphanage.AddChildrenToWorkSet(CTransaction(parent), work_set);
+    BOOST_CHECK(work_set == std::set<uint256>({child0->GetHash()}));
+
+    // A block spending the parent's output removes the child.
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(OrphanSpending(parent.GetHash(), key)));
+    orphanage.EraseForBlock(block);
+    BOOST_CHECK(!orphanage.HaveTx(child0->GetHash()));
+    BOOST_CHECK_EQUAL(orphanage.PeerBytes(3), 0U);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -123,4 +123,51 @@ BOOST_AUTO_TEST_CASE(flatfile_flush)
     BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 1))), 1);
 }
 
+BOOST_AUTO_TEST_CASE(flatfile_map)
+{
+    const auto data_dir = GetDataDir();
+    FlatFileSeq seq(data_dir, "a", 16 * 1024);
+
+    // Nothing to map for a file that does not exist.
+    BOOST_CHECK(!seq.Map(FlatFilePos(0, 0), 1));
+
+    const std::vector<unsigned char> data1(100, 0x01);
+    const std::vector<unsigned char> data2(100, 0x02);
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, 0)), SER_DISK, CLIENT_VERSION);
+        file.write((const char*)data1.data(), data1.size());
+    }
+
+    auto mapping = seq.Map(FlatFilePos(0, 10), 50);
+#ifndef WIN32
+    if (sizeof(void*) >= 8) {
+        BOOST_REQUIRE(mapping);
+        BOOST_CHECK(mapping->Get(10, 50) == Span<const unsigned char>(data1.data(), 50));
+        // A range past the end of the file can not be mapped.
+        BOOST_CHECK(!seq.Map(FlatFilePos(0, 90), 20));
+        // The mapping is shared while it covers the requested range.
+        BOOST_CHECK(seq.Map(FlatFilePos(0, 0), 100) == mapping);
+    }
+#endif
+
+    // Append to the file; the file is remapped to cover the new data while the
+    // old mapping stays usable.
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, 100)), SER_DISK, CLIENT_VERSION);
+        file.write((const char*)data2.data(), data2.size());
+    }
+    auto remapped = seq.Map(FlatFilePos(0, 100), 100);
+    if (mapping) {
+        BOOST_REQUIRE(remapped);
+        BOOST_CHECK(remapped != mapping);
+        BOOST_CHECK(remapped->Get(100, 100) == MakeSpan(data2));
+        BOOST_CHECK(mapping->Get(0, 100) == MakeSpan(data1));
+    }
+
+    // After unmapping, a new mapping is created.
+    seq.Unmap(FlatFilePos(0, 0));
+    auto fresh = seq.Map(FlatFilePos(0, 0), 200);
+    BOOST_CHECK(!mapping || (fresh && fresh != remapped));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,8 +5,11 @@
 #include <netaddress.h>
 #include <test/fuzz/FuzzedDataProvider.h>
 #include <test/fuzz/fuzz.h>
+#include <util/asmap.h>
 
+#include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <vector>
 
 void test_one_input(const std::vector<uint8_t>& buffer)
@@ -24,5 +27,14 @@ void test_one_input(const std::vector<uint8_t>& buffer)
             asmap.push_back((cur_byte >> bit) & 1);
         }
     }
-    (void)net_addr.GetMappedAS(asmap);
+    const Asmap table(asmap);
+    (void)net_addr.GetMappedAS(table);
+
+    // The decoded table must agree with the interpreter, however malformed the bytecode.
+    std::vector<bool> ip_bits(128);
+    unsigned char ip[16];
+    const std::vector<unsigned char> addr_bytes = net_addr.GetAddrBytes();
+    memcpy(ip, addr_bytes.data(), sizeof(ip));
+    for (int i = 0; i < 128; ++i) ip_bits[i] = (ip[i / 8] >> (7 - i % 8)) & 1;
+    assert(table.Lookup(ip) == Interpret(asmap, ip_bits));
 }
@@ -147,4 +147,23 @@ BOOST_AUTO_TEST_CASE(siphash)
     }
 }
 
+BOOST_AUTO_TEST_CASE(siphash_multi)
+{
+    // Check consistency between SipHashUint256Multi and SipHashUint256, for
+    // counts that do and do not fill the multi-way implementations.
+    const uint64_t k1 = InsecureRandBits(64);
+    const uint64_t k2 = InsecureRandBits(64);
+    std::vector<uint256> vals(11);
+    std::vector<const uint256*> ptrs;
+    for (const uint256& val : vals) ptrs.push_back(&val);
+    for (uint256& val : vals) val = InsecureRand256();
+    for (size_t count = 0; count <= vals.size(); ++count) {
+        std::vector<uint64_t> out(count);
+        SipHashUint256Multi(k1, k2, ptrs.data(), count, out.data());
+        for (size_t i = 0; i < count; ++i) {
+            BOOST_CHECK_EQUAL(out[i], SipHashUint256(k1, k2, vals[i]));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 
 #include <policy/policy.h>
 #include <txmempool.h>
+#include <util/rbf.h>
 #include <util/system.h>
 #include <util/time.h>
 
@@ -537,7 +538,9 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
         pool.addUnchecked(entry.Fee(1000LL).FromTx(tx5));
     pool.addUnchecked(entry.Fee(9000LL).FromTx(tx7));
 
-    pool.TrimToSize(pool.DynamicMemoryUsage() / 2); // should maximize mempool size by only removing 5/7
+    // With pooled nodes a transaction costs less memory, so the pool's fixed
+    // usage is a larger share of the total than half of it.
+    pool.TrimToSize(pool.DynamicMemoryUsage() * 3 / 5); // should maximize mempool size by only removing 5/7
     BOOST_CHECK(pool.exists(tx4.GetHash()));
     BOOST_CHECK(!pool.exists(tx5.GetHash()));
     BOOST_CHECK(pool.exists(tx6.GetHash()));
@@ -788,4 +791,202 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 4ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolInfoForRelayTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // A low fee parent with a high fee child, and an unrelated transaction
+    CTransactionRef parent = make_tx(/* output_values */ {10 * COIN});
+    CTransactionRef child = make_tx(/* output_values */ {9 * COIN}, /* inputs */ {parent});
+    CTransactionRef other = make_tx(/* output_values */ {11 * COIN});
+    CTransactionRef missing = make_tx(/* output_values */ {12 * COIN});
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(parent));
+    pool.addUnchecked(entry.Fee(100000LL).FromTx(child));
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(other));
+
+    // Parents come before their children whatever their fee, and transactions
+    // not in the mempool are left out.
+    std::vector<TxMempoolInfo> info = pool.InfoForRelay({child->GetHash(), missing->GetHash(), parent->GetHash(), other->GetHash()});
+    BOOST_REQUIRE_EQUAL(info.size(), 3U);
+    BOOST_CHECK(info[0].tx->GetHash() == other->GetHash());
+    BOOST_CHECK(info[1].tx->GetHash() == parent->GetHash());
+    BOOST_CHECK(info[2].tx->GetHash() == child->GetHash());
+
+    BOOST_CHECK(pool.InfoForRelay({missing->GetHash()}).empty());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolClusterTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+    const auto cluster = [&](const CTransactionRef& tx) -> const CTxMemPool::Cluster& {
+        return pool.GetCluster(*pool.GetIter(tx->GetHash()));
+    };
+
+    // A chain a <- b <- c, and an unrelated transaction d
+    CTransactionRef a = make_tx(/* output_values */ {10 * COIN});
+    CTransactionRef b = make_tx(/* output_values */ {9 * COIN}, /* inputs */ {a});
+    CTransactionRef c = make_tx(/* output_values */ {8 * COIN}, /* inputs */ {b});
+    CTransactionRef d = make_tx(/* output_values */ {7 * COIN});
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(a));
+    pool.addUnchecked(entry.Fee(2000LL).FromTx(b));
+    pool.addUnchecked(entry.Fee(3000LL).FromTx(c));
+    pool.addUnchecked(entry.Fee(4000LL).FromTx(d));
+    BOOST_CHECK_EQUAL(pool.GetClusterCount(), 2U);
+    BOOST_CHECK_EQUAL(cluster(a).members.size(), 3U);
+    BOOST_CHECK(&cluster(a) == &cluster(c));
+    BOOST_CHECK_EQUAL(cluster(a).nModFees, 6000);
+    uint64_t nSize = 0;
+    for (const CTransactionRef& tx : {a, b, c}) nSize += (*pool.GetIter(tx->GetHash()))->GetTxSize();
+    BOOST_CHECK_EQUAL(cluster(a).nSize, nSize);
+    BOOST_CHECK_EQUAL(cluster(d).members.size(), 1U);
+
+    // A transaction spending c and d joins both clusters
+    CTransactionRef e = make_tx(/* output_values */ {1 * COIN}, /* inputs */ {c, d});
+    CTxMemPool::setEntries setAncestors;
+    std::string dummy;
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    pool.CalculateMemPoolAncestors(entry.FromTx(e), setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy);
+    BOOST_CHECK_EQUAL(pool.GetClusterSizeWith(setAncestors), 5U);
+    pool.addUnchecked(entry.Fee(5000LL).FromTx(e));
+    BOOST_CHECK_EQUAL(pool.GetClusterCount(), 1U);
+    BOOST_CHECK_EQUAL(cluster(a).members.size(), 5U);
+    BOOST_CHECK(&cluster(a) == &cluster(d));
+    BOOST_CHECK_EQUAL(cluster(a).nModFees, 15000);
+
+    // Prioritisation is reflected in the cluster's fees
+    pool.PrioritiseTransaction(d->GetHash(), 500);
+    BOOST_CHECK_EQUAL(cluster(a).nModFees, 15500);
+
+    // Removing c and its descendant e leaves {a, b} and {d}
+    pool.removeRecursive(*c, REMOVAL_REASON_DUMMY);
+    BOOST_CHECK_EQUAL(pool.GetClusterCount(), 2U);
+    BOOST_CHECK_EQUAL(cluster(a).members.size(), 2U);
+    BOOST_CHECK_EQUAL(cluster(a).nModFees, 3000);
+    BOOST_CHECK_EQUAL(cluster(d).members.size(), 1U);
+    BOOST_CHECK_EQUAL(cluster(d).nModFees, 4500);
+
+    // Mining a leaves b on its own, with its ancestor state updated
+    pool.removeForBlock({a}, 1);
+    BOOST_CHECK_EQUAL(pool.GetClusterCount(), 2U);
+    BOOST_CHECK_EQUAL(cluster(b).members.size(), 1U);
+    BOOST_CHECK_EQUAL((*pool.GetIter(b->GetHash()))->GetCountWithAncestors(), 1U);
+
+    // Mining whole clusters empties the mempool
+    pool.removeForBlock({b, d}, 2);
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    BOOST_CHECK_EQUAL(pool.GetClusterCount(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSnapshotTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // a signals replaceability, which makes its child b replaceable as well
+    CMutableTransaction mtx_a(*make_tx(/* output_values */ {10 * COIN}, /* inputs */ {make_tx(/* output_values */ {11 * COIN})}));
+    mtx_a.vin[0].nSequence = MAX_BIP125_RBF_SEQUENCE;
+    CTransactionRef a = MakeTransactionRef(mtx_a);
+    CTransactionRef b = make_tx(/* output_values */ {9 * COIN}, /* inputs */ {a});
+    CTransactionRef c = make_tx(/* output_values */ {8 * COIN});
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(a));
+    pool.addUnchecked(entry.Fee(2000LL).FromTx(b));
+    pool.addUnchecked(entry.Fee(3000LL).FromTx(c));
+
+    std::shared_ptr<const MempoolSnapshot> snapshot = pool.GetSnapshot();
+    BOOST_REQUIRE_EQUAL(snapshot->entries.size(), 3U);
+    BOOST_CHECK(std::is_sorted(snapshot->entries.begin(), snapshot->entries.end(),
+        [](const MempoolSnapshot::Entry& x, const MempoolSnapshot::Entry& y) { return x.txid < y.txid; }));
+    const MempoolSnapshot::Entry* entry_a = snapshot->Find(a->GetHash());
+    const MempoolSnapshot::Entry* entry_b = snapshot->Find(b->GetHash());
+    const MempoolSnapshot::Entry* entry_c = snapshot->Find(c->GetHash());
+    BOOST_REQUIRE(entry_a && entry_b && entry_c);
+    BOOST_CHECK(!snapshot->Find(make_tx(/* output_values */ {12 * COIN})->GetHash()));
+    BOOST_CHECK(entry_a->wtxid == a->GetWitnessHash());
+    BOOST_CHECK_EQUAL(entry_b->fee, 2000);
+    BOOST_CHECK_EQUAL(entry_a->count_with_descendants, 2U);
+    BOOST_CHECK_EQUAL(entry_a->mod_fees_with_descendants, 3000);
+    BOOST_CHECK_EQUAL(entry_b->count_with_ancestors, 2U);
+    BOOST_CHECK(entry_a->parents.empty());
+    BOOST_CHECK(entry_a->children == std::vector<uint256>{b->GetHash()});
+    BOOST_CHECK(entry_b->parents == std::vector<uint256>{a->GetHash()});
+    BOOST_CHECK(entry_a->bip125_replaceable);
+    BOOST_CHECK(entry_b->bip125_replaceable);
+    BOOST_CHECK(!entry_c->bip125_replaceable);
+
+    // The same snapshot is handed out until the mempool changes
+    BOOST_CHECK(pool.GetSnapshot() == snapshot);
+    pool.PrioritiseTransaction(b->GetHash(), 500);
+    std::shared_ptr<const MempoolSnapshot> prioritised = pool.GetSnapshot();
+    BOOST_CHECK(prioritised != snapshot);
+    BOOST_CHECK_EQUAL(prioritised->Find(b->GetHash())->modified_fee, 2500);
+    BOOST_CHECK_EQUAL(prioritised->Find(a->GetHash())->mod_fees_with_descendants, 3500);
+    // and earlier ones stay as they were
+    BOOST_CHECK_EQUAL(entry_b->modified_fee, 2000);
+
+    pool.removeRecursive(*a, REMOVAL_REASON_DUMMY);
+    snapshot = pool.GetSnapshot();
+    BOOST_REQUIRE_EQUAL(snapshot->entries.size(), 1U);
+    BOOST_CHECK(snapshot->entries[0].txid == c->GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolEventLogTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+    bool gap;
+    uint64_t next_sequence;
+
+    BOOST_CHECK(pool.GetEvents(0, gap, next_sequence).empty());
+    BOOST_CHECK(!gap);
+    BOOST_CHECK_EQUAL(next_sequence, 0U);
+
+    CTransactionRef a = make_tx(/* output_values */ {10 * COIN});
+    CTransactionRef b = make_tx(/* output_values */ {9 * COIN}, /* inputs */ {a});
+    CTransactionRef c = make_tx(/* output_values */ {8 * COIN});
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(a));
+    pool.addUnchecked(entry.Fee(2000LL).FromTx(b));
+    BOOST_CHECK_EQUAL(pool.GetSnapshot()->event_sequence, 2U);
+    pool.addUnchecked(entry.Fee(3000LL).FromTx(c));
+    // Removals for blocks are logged as well, followed by the block
+    pool.removeForBlock({a}, 1);
+    const uint256 block_hash = InsecureRand256();
+    pool.LogBlockEvent(MempoolEvent::Type::BLOCK_CONNECTED, block_hash);
+    pool.removeRecursive(*b, MemPoolRemovalReason::CONFLICT);
+    BOOST_CHECK_EQUAL(pool.GetSnapshot()->event_sequence, 6U);
+
+    const std::vector<MempoolEvent> events = pool.GetEvents(0, gap, next_sequence);
+    BOOST_CHECK(!gap);
+    BOOST_CHECK_EQUAL(next_sequence, 6U);
+    BOOST_REQUIRE_EQUAL(events.size(), 6U);
+    const std::vector<std::pair<MempoolEvent::Type, uint256>> expected{
+        {MempoolEvent::Type::ADDED, a->GetHash()},
+        {MempoolEvent::Type::ADDED, b->GetHash()},
+        {MempoolEvent::Type::ADDED, c->GetHash()},
+        {MempoolEvent::Type::REMOVED, a->GetHash()},
+        {MempoolEvent::Type::BLOCK_CONNECTED, block_hash},
+        {MempoolEvent::Type::REMOVED, b->GetHash()},
+    };
+    for (size_t i = 0; i < events.size(); ++i) {
+        BOOST_CHECK_EQUAL(events[i].sequence, i);
+        BOOST_CHECK(events[i].type == expected[i].first);
+        BOOST_CHECK(events[i].hash == expected[i].second);
+        BOOST_CHECK_EQUAL(bool(events[i].reason), events[i].type == MempoolEvent::Type::REMOVED);
+    }
+    BOOST_CHECK(*events[3].reason == MemPoolRemovalReason::BLOCK);
+    BOOST_CHECK(*events[5].reason == MemPoolRemovalReason::CONFLICT);
+
+    // Events from a sequence number on, up to the latest
+    const std::vector<MempoolEvent> tail = pool.GetEvents(4, gap, next_sequence);
+    BOOST_REQUIRE_EQUAL(tail.size(), 2U);
+    BOOST_CHECK_EQUAL(tail[0].sequence, 4U);
+    BOOST_CHECK(pool.GetEvents(6, gap, next_sequence).empty());
+    BOOST_CHECK(!gap);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -16,6 +16,7 @@
 #include <util/system.h>
 #include <util/time.h>
 #include <validation.h>
+#include <validationinterface.h>
 
 #include <test/util/setup_common.h>
 
@@ -526,4 +527,65 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+BOOST_AUTO_TEST_CASE(BlockTemplateBuilder_extends_selection)
+{
+    const CChainParams& chainparams = Params();
+    const CScript scriptPubKey = CScript() << OP_TRUE;
+    BlockAssembler::Options options;
+    options.nBlockMaxWeight = MAX_BLOCK_WEIGHT;
+    options.blockMinFeeRate = blockMinFeeRate;
+    BlockTemplateBuilder builder(*m_node.mempool, chainparams, options);
+    RegisterValidationInterface(&builder);
+
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = scriptPubKey;
+    tx.vout[0].nValue = 1000000;
+
+    // A low and a higher fee transaction
+    tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+    const CTransactionRef low_fee_tx = MakeTransactionRef(tx);
+    tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+    const CTransactionRef medium_fee_tx = MakeTransactionRef(tx);
+    {
+        LOCK2(cs_main, m_node.mempool->cs);
+        m_node.mempool->addUnchecked(entry.Fee(1000).FromTx(low_fee_tx));
+        m_node.mempool->addUnchecked(entry.Fee(10000).FromTx(medium_fee_tx));
+    }
+    std::unique_ptr<CBlockTemplate> pblocktemplate = builder.CreateNewBlock(scriptPubKey);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 3U);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == medium_fee_tx->GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == low_fee_tx->GetHash());
+
+    // A high fee child of the low fee transaction is added to the previous
+    // selection, where selecting from scratch would put its package first.
+    tx.vin[0].prevout = COutPoint(low_fee_tx->GetHash(), 0);
+    const CTransactionRef high_fee_tx = MakeTransactionRef(tx);
+    {
+        LOCK2(cs_main, m_node.mempool->cs);
+        m_node.mempool->addUnchecked(entry.Fee(50000).FromTx(high_fee_tx));
+    }
+    GetMainSignals().TransactionAddedToMempool(high_fee_tx);
+    SyncWithValidationInterfaceQueue();
+    pblocktemplate = builder.CreateNewBlock(scriptPubKey);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 4U);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == medium_fee_tx->GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == low_fee_tx->GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[3]->GetHash() == high_fee_tx->GetHash());
+    BOOST_CHECK(AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey)->block.vtx[1]->GetHash() == low_fee_tx->GetHash());
+
+    // Removing selected transactions makes the next selection start over.
+    m_node.mempool->removeRecursive(*low_fee_tx, MemPoolRemovalReason::REPLACED);
+    SyncWithValidationInterfaceQueue();
+    pblocktemplate = builder.CreateNewBlock(scriptPubKey);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 2U);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == medium_fee_tx->GetHash());
+
+    UnregisterValidationInterface(&builder);
+    m_node.mempool->clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
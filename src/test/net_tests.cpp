@@ -11,6 +11,7 @@
 #include <serialize.h>
 #include <streams.h>
 #include <net.h>
+#include <netmessagemaker.h>
 #include <netbase.h>
 #include <chainparams.h>
 #include <util/memory.h>
@@ -319,4 +320,89 @@ BOOST_AUTO_TEST_CASE(PoissonNextSend)
     g_mock_deterministic_tests = false;
 }
 
+BOOST_AUTO_TEST_CASE(push_message_shared_payload)
+{
+    CConnman connman(0x1337, 0x1337);
+    CAddress addr(CService(CNetAddr(), 0), NODE_NONE);
+    const CNetMsgMaker msg_maker(INIT_PROTO_VERSION);
+    std::shared_ptr<const std::vector<unsigned char>> payload = msg_maker.MakePayload(0, std::vector<unsigned char>(1000, 0x42));
+
+    // Without a socket everything stays queued; the payload must be queued
+    // by reference, not copied.
+    CNode queued(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", false);
+    connman.PushMessage(&queued, msg_maker.MakeShared("block", payload));
+    connman.PushMessage(&queued, msg_maker.MakeShared("block", payload));
+    {
+        LOCK(queued.cs_vSend);
+        BOOST_REQUIRE_EQUAL(queued.vSendMsg.size(), 4U);
+        BOOST_CHECK(queued.vSendMsg[1] == payload);
+        BOOST_CHECK(queued.vSendMsg[3] == payload);
+    }
+
+#ifndef WIN32
+    // Everything pushed arrives in order, headers and payloads alike.
+    int fds[2];
+    BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    CNode node(1, NODE_NETWORK, 0, fds[0], addr, 0, 0, CAddress(), "", false);
+    std::vector<unsigned char> expected;
+    for (int i = 0; i < 3; ++i) {
+        CSerializedNetMsg msg = i == 1 ? msg_maker.Make("ping", uint64_t{7}) : msg_maker.MakeShared("block", payload);
+        std::vector<unsigned char> header;
+        V1TransportSerializer().prepareForTransport(msg, header);
+        expected.insert(expected.end(), header.begin(), header.end());
+        expected.insert(expected.end(), msg.Payload().begin(), msg.Payload().end());
+        connman.PushMessage(&node, std::move(msg));
+    }
+    WITH_LOCK(node.cs_vSend, BOOST_CHECK(node.vSendMsg.empty()));
+    std::vector<unsigned char> received(expected.size());
+    size_t read = 0;
+    while (read < received.size()) {
+        ssize_t n = recv(fds[1], received.data() + read, received.size() - read, 0);
+        BOOST_REQUIRE(n > 0);
+        read += n;
+    }
+    BOOST_CHECK(received == expected);
+    close(fds[1]);
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(transport_deserializer_payload_buffer)
+{
+    const CNetMsgMaker msg_maker(INIT_PROTO_VERSION);
+    std::vector<unsigned char> data(300 * 1024);
+    for (size_t i = 0; i < data.size(); ++i) data[i] = i % 251;
+    CSerializedNetMsg msg = msg_maker.Make("block", data);
+    std::vector<unsigned char> header;
+    V1TransportSerializer().prepareForTransport(msg, header);
+    const Span<const unsigned char> payload = msg.Payload();
+
+    V1TransportDeserializer deserializer(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+    BOOST_CHECK(deserializer.GetPayloadBuffer(MAX_SIZE).size() == 0);
+    BOOST_REQUIRE_EQUAL(deserializer.Read((const char*)header.data(), header.size()), (int)header.size());
+
+    // Mix both ways of feeding the payload; the buffer only grows with
+    // what was received.
+    BOOST_REQUIRE_EQUAL(deserializer.Read((const char*)payload.data(), 1000), 1000);
+    size_t pos = 1000;
+    while (!deserializer.Complete()) {
+        Span<unsigned char> buf = deserializer.GetPayloadBuffer(MAX_SIZE);
+        BOOST_REQUIRE(buf.size() > 0);
+        BOOST_CHECK(buf.size() <= std::max<std::ptrdiff_t>(pos, 256 * 1024));
+        memcpy(buf.data(), payload.data() + pos, buf.size());
+        deserializer.PayloadReceived(buf.size());
+        pos += buf.size();
+    }
+    BOOST_CHECK_EQUAL(pos, payload.size());
+    BOOST_CHECK(deserializer.GetPayloadBuffer(MAX_SIZE).size() == 0);
+
+    CNetMessage result = deserializer.GetMessage(Params().MessageStart(), 0);
+    BOOST_CHECK(result.m_valid_header);
+    BOOST_CHECK(result.m_valid_checksum);
+    BOOST_CHECK_EQUAL(result.m_command, "block");
+    BOOST_CHECK_EQUAL(result.m_message_size, payload.size());
+    std::vector<unsigned char> decoded;
+    result.m_recv >> decoded;
+    BOOST_CHECK(decoded == data);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
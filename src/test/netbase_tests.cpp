@@ -4,9 +4,11 @@
 
 #include <netbase.h>
 #include <net_permissions.h>
+#include <subnettrie.h>
 #include <test/util/setup_common.h>
 #include <util/strencodings.h>
 
+#include <set>
 #include <string>
 
 #include <boost/test/unit_test.hpp>
@@ -284,9 +286,64 @@ BOOST_AUTO_TEST_CASE(subnet_test)
 
 }
 
+BOOST_AUTO_TEST_CASE(subnet_trie)
+{
+    const std::vector<CSubNet> subnets{
+        ResolveSubNet("1.2.3.0/24"), ResolveSubNet("1.2.0.0/16"), ResolveSubNet("1.2.3.4"),
+        ResolveSubNet("::/0"), ResolveSubNet("0.0.0.0/0"), ResolveSubNet("1:2:3:4::/64"),
+        ResolveSubNet("1:2:3:4:5:6:7:8"), ResolveSubNet("FD87:D87E:EB43::/48"),
+        ResolveSubNet("10.0.0.0/255.0.255.0"), CSubNet()};
+    SubNetTrie<int> trie;
+    for (size_t i = 0; i < subnets.size(); ++i) {
+        trie[subnets[i]] = i;
+    }
+    BOOST_CHECK_EQUAL(trie.Size(), subnets.size());
+    // Adding a subnet again does not add an entry
+    BOOST_CHECK_EQUAL(trie[ResolveSubNet("1.2.3.0/255.255.255.0")], 0);
+    BOOST_CHECK_EQUAL(trie.Size(), subnets.size());
+
+    auto check_matches = [&](const CNetAddr& addr) {
+        std::set<int> expected, found;
+        for (size_t i = 0; i < subnets.size(); ++i) {
+            if (subnets[i].Match(addr)) expected.insert(i);
+        }
+        BOOST_CHECK(!trie.ForEachMatch(addr, [&](int i) { found.insert(i); return false; }));
+        BOOST_CHECK(expected == found);
+    };
+    for (const std::string addr : {"1.2.3.4", "1.2.3.5", "1.2.4.4", "1.3.0.0", "10.5.0.7", "10.5.1.7",
+                                   "1:2:3:4:5:6:7:8", "1:2:3:4::1", "1:2:3:5::1", "5wyqrzbvrdsumnok.onion"}) {
+        check_matches(ResolveIP(addr));
+    }
+    check_matches(CNetAddr());
+
+    // Broader prefixes come first, and the search stops when asked to
+    int first = -1;
+    BOOST_CHECK(trie.ForEachMatch(ResolveIP("1.2.3.4"), [&](int i) { first = i; return true; }));
+    BOOST_CHECK_EQUAL(first, 3); // ::/0
+
+    BOOST_CHECK(trie.Erase(ResolveSubNet("::/0")));
+    BOOST_CHECK(!trie.Erase(ResolveSubNet("::/0")));
+    BOOST_CHECK(trie.Erase(ResolveSubNet("10.0.0.0/255.0.255.0")));
+    BOOST_CHECK(!trie.Erase(ResolveSubNet("1.2.3.0/25")));
+    BOOST_CHECK_EQUAL(trie.Size(), subnets.size() - 2);
+    BOOST_CHECK(!trie.ForEachMatch(ResolveIP("1:2:3:5::1"), [](int) { return true; }));
+    BOOST_CHECK(!trie.ForEachMatch(ResolveIP("10.5.0.7"), [](int i) { return i == 8; }));
+    BOOST_CHECK(trie.ForEachMatch(ResolveIP("1.2.3.4"), [](int i) { return i == 2; }));
+
+    trie.Clear();
+    BOOST_CHECK_EQUAL(trie.Size(), 0U);
+    BOOST_CHECK(!trie.ForEachMatch(ResolveIP("1.2.3.4"), [](int) { return true; }));
+
+    BOOST_CHECK_EQUAL(ResolveSubNet("1.2.3.0/24").GetPrefixLength(), 120);
+    BOOST_CHECK_EQUAL(ResolveSubNet("1:2:3:4::/64").GetPrefixLength(), 64);
+    BOOST_CHECK_EQUAL(ResolveSubNet("::/0").GetPrefixLength(), 0);
+    BOOST_CHECK_EQUAL(ResolveSubNet("10.0.0.0/255.0.255.0").GetPrefixLength(), -1);
+    BOOST_CHECK_EQUAL(CSubNet().GetPrefixLength(), -1);
+}
+
 BOOST_AUTO_TEST_CASE(netbase_getgroup)
 {
-    std::vector<bool> asmap; // use /16
+    Asmap asmap; // use /16
     BOOST_CHECK(ResolveIP("127.0.0.1").GetGroup(asmap) == std::vector<unsigned char>({0})); // Local -> !Routable()
     BOOST_CHECK(ResolveIP("257.0.0.1").GetGroup(asmap) == std::vector<unsigned char>({0})); // !Valid -> !Routable()
     BOOST_CHECK(ResolveIP("10.0.0.1").GetGroup(asmap) == std::vector<unsigned char>({0})); // RFC1918 -> !Routable()
@@ -0,0 +1,91 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
+#include <net.h>
+#include <netmetrics.h>
+#include <protocol.h>
+#include <sync.h>
+#include <test/util/setup_common.h>
+
+#include <chrono>
+#include <limits>
+#include <string>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(netmetrics_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(log_histogram)
+{
+    LogHistogram histogram;
+    for (int64_t value : {-5, 0, 1, 2, 3, 4, 1000}) {
+        histogram.Record(value);
+    }
+    histogram.Record(std::numeric_limits<int64_t>::max());
+
+    const LogHistogram::Snapshot snapshot = histogram.GetSnapshot();
+    BOOST_CHECK_EQUAL(snapshot.count, 8U);
+    BOOST_CHECK_EQUAL(snapshot.sum, 1010U + uint64_t(std::numeric_limits<int64_t>::max()));
+    BOOST_CHECK_EQUAL(snapshot.counts[0], 2U); // -5 and 0
+    BOOST_CHECK_EQUAL(snapshot.counts[1], 1U); // 1
+    BOOST_CHECK_EQUAL(snapshot.counts[2], 2U); // 2 and 3
+    BOOST_CHECK_EQUAL(snapshot.counts[3], 1U); // 4
+    BOOST_CHECK_EQUAL(snapshot.counts[10], 1U); // 1000 < 1024
+    BOOST_CHECK_EQUAL(snapshot.counts[LogHistogram::BUCKETS - 1], 1U);
+    BOOST_CHECK_EQUAL(LogHistogram::BucketLimit(10), 1024U);
+}
+
+BOOST_AUTO_TEST_CASE(message_types)
+{
+    NetMetrics metrics;
+    NetMetrics::ForMessageType(metrics.process_time, NetMsgType::TX).Record(5);
+    NetMetrics::ForMessageType(metrics.process_time, "nosuchtype").Record(7);
+    BOOST_CHECK_EQUAL(metrics.process_time.at(NetMsgType::TX).GetSnapshot().sum, 5U);
+    BOOST_CHECK_EQUAL(metrics.process_time.at(NET_MESSAGE_COMMAND_OTHER).GetSnapshot().sum, 7U);
+    BOOST_CHECK(!metrics.process_time.count("nosuchtype"));
+    BOOST_CHECK(metrics.cs_main_hold_time.count(NetMetrics::SEND_MESSAGES));
+
+    const std::string text = metrics.ToPrometheus();
+    BOOST_CHECK(text.find("bitcoin_net_message_process_seconds_count{msgtype=\"tx\"} 1\n") != std::string::npos);
+    BOOST_CHECK(text.find("bitcoin_net_message_process_seconds_bucket{msgtype=\"tx\",le=\"+Inf\"} 1\n") != std::string::npos);
+    // Message types never seen are left out
+    BOOST_CHECK(text.find("msgtype=\"block\"") == std::string::npos);
+    BOOST_CHECK(text.find("# TYPE bitcoin_net_send_queue_bytes histogram\n") != std::string::npos);
+    BOOST_CHECK(text.find("bitcoin_net_send_queue_bytes_count 0\n") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(hold_timer)
+{
+    HoldTimedRecursiveMutex mutex;
+    LogHistogram held;
+    {
+        ScopedHoldTimer timer(held);
+        LOCK(mutex);
+        {
+            // Recursive locking does not count twice
+            LOCK(mutex);
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    LogHistogram not_held;
+    {
+        ScopedHoldTimer timer(not_held);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+#ifdef HAVE_THREAD_LOCAL
+    BOOST_CHECK_GE(held.GetSnapshot().sum, 4000U);
+    // Generous, for slow machines
+    BOOST_CHECK_LT(held.GetSnapshot().sum, 1000000U);
+#endif
+    BOOST_CHECK_EQUAL(not_held.GetSnapshot().sum, 0U);
+    BOOST_CHECK_EQUAL(not_held.GetSnapshot().count, 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
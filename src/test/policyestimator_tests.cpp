@@ -12,7 +12,7 @@
 
 #include <boost/test/unit_test.hpp>
 
-BOOST_FIXTURE_TEST_SUITE(policyestimator_tests, BasicTestingSetup)
+BOOST_FIXTURE_TEST_SUITE(policyestimator_tests, TestingSetup)
 
 BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
 {
@@ -180,4 +180,74 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+BOOST_AUTO_TEST_CASE(SmartFeeTableMatchesEstimates)
+{
+    CBlockPolicyEstimator feeEst;
+    CTxMemPool mpool(&feeEst);
+    LOCK2(cs_main, mpool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // Every target and both modes give the same answer from the per-block
+    // table as computed directly from the tracked data
+    auto check_estimates = [&] {
+        for (int target = 0; target <= 1010; target++) {
+            for (bool conservative : {false, true}) {
+                FeeCalculation table_calc, direct_calc;
+                CFeeRate table_rate = feeEst.estimateSmartFee(target, &table_calc, conservative);
+                CFeeRate direct_rate = feeEst.estimateSmartFeeUncached(target, &direct_calc, conservative);
+                BOOST_CHECK(table_rate == direct_rate);
+                BOOST_CHECK(table_calc.reason == direct_calc.reason);
+                BOOST_CHECK_EQUAL(table_calc.desiredTarget, direct_calc.desiredTarget);
+                BOOST_CHECK_EQUAL(table_calc.returnedTarget, direct_calc.returnedTarget);
+                BOOST_CHECK_EQUAL(table_calc.est.pass.withinTarget, direct_calc.est.pass.withinTarget);
+                BOOST_CHECK_EQUAL(table_calc.est.pass.inMempool, direct_calc.est.pass.inMempool);
+                BOOST_CHECK_EQUAL(table_calc.est.fail.totalConfirmed, direct_calc.est.fail.totalConfirmed);
+                BOOST_CHECK_EQUAL(table_calc.est.fail.inMempool, direct_calc.est.fail.inMempool);
+                BOOST_CHECK_EQUAL(table_calc.est.scale, direct_calc.est.scale);
+            }
+        }
+    };
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 0;
+    std::vector<CTransactionRef> block;
+    std::vector<std::pair<uint256, CAmount>> pending;
+
+    // Start above the longest horizon, where the circular buffers of
+    // unconfirmed transactions do not wrap below height 0
+    unsigned int height = 2000;
+    while (height < 2120) {
+        for (int i = 0; i < 20; i++) {
+            tx.vin[0].prevout.n = 100 * height + i;
+            CAmount fee = 1000 + InsecureRandRange(50000);
+            mpool.addUnchecked(entry.Fee(fee).Time(GetTime()).Height(height).FromTx(tx));
+            pending.emplace_back(tx.GetHash(), fee);
+        }
+        if (height % 40 == 0) check_estimates();
+
+        // Higher fee transactions are more likely to be mined, some are never
+        for (auto it = pending.begin(); it != pending.end();) {
+            if ((CAmount)InsecureRandRange(50000) < it->second - 10000) {
+                block.push_back(mpool.get(it->first));
+                it = pending.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        mpool.removeForBlock(block, ++height);
+        block.clear();
+        if (height % 30 == 0) check_estimates();
+    }
+
+    // Evicting transactions from the mempool changes the estimates
+    for (size_t i = 0; i < pending.size(); i += 3) {
+        mpool.removeRecursive(*mpool.get(pending[i].first), MemPoolRemovalReason::EXPIRY);
+    }
+    check_estimates();
+    mpool.removeForBlock(block, ++height);
+    check_estimates();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
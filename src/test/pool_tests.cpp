@@ -0,0 +1,122 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <memusage.h>
+#include <support/allocators/pool.h>
+
+#include <test/util/setup_common.h>
+
+#include <map>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+typedef PoolResource<128, 8> TestResource;
+
+BOOST_AUTO_TEST_CASE(pool_reuse)
+{
+    TestResource resource(1024);
+    void* a = resource.Allocate(20, 8);
+    void* b = resource.Allocate(20, 8);
+    BOOST_CHECK(a != b);
+    // Rounded up to a multiple of the alignment
+    BOOST_CHECK_EQUAL(resource.PooledBytes(), 48U);
+    BOOST_CHECK_EQUAL(resource.ChunkBytes(), 1024U);
+
+    // A freed block is handed out again to the next allocation of its size
+    resource.Deallocate(a, 20, 8);
+    BOOST_CHECK_EQUAL(resource.PooledBytes(), 24U);
+    void* c = resource.Allocate(24, 8);
+    BOOST_CHECK(c == a);
+    // but not to one of another size
+    void* d = resource.Allocate(32, 8);
+    BOOST_CHECK(d != a && d != b);
+
+    resource.Deallocate(b, 20, 8);
+    resource.Deallocate(c, 24, 8);
+    resource.Deallocate(d, 32, 8);
+    BOOST_CHECK_EQUAL(resource.PooledBytes(), 0U);
+    BOOST_CHECK_EQUAL(resource.ChunkBytes(), 1024U);
+}
+
+BOOST_AUTO_TEST_CASE(pool_chunks)
+{
+    TestResource resource(1024);
+    std::vector<std::pair<void*, size_t>> blocks;
+    for (int i = 0; i < 7; ++i) {
+        blocks.emplace_back(resource.Allocate(128, 8), 128);
+    }
+    char* first = static_cast<char*>(blocks.front().first);
+    blocks.emplace_back(resource.Allocate(96, 8), 96);
+    BOOST_CHECK_EQUAL(resource.ChunkBytes(), 1024U);
+
+    // 32 bytes are left in the first chunk, so this needs a new one
+    blocks.emplace_back(resource.Allocate(128, 8), 128);
+    BOOST_CHECK_EQUAL(resource.ChunkBytes(), 2048U);
+    BOOST_CHECK_EQUAL(resource.PooledBytes(), 8U * 128 + 96);
+
+    // and the rest of the first one is handed out as a smaller block
+    blocks.emplace_back(resource.Allocate(32, 8), 32);
+    BOOST_CHECK(blocks.back().first == first + 7 * 128 + 96);
+    BOOST_CHECK_EQUAL(resource.ChunkBytes(), 2048U);
+
+    for (const auto& block : blocks) {
+        resource.Deallocate(block.first, block.second, 8);
+    }
+    BOOST_CHECK_EQUAL(resource.PooledBytes(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(pool_passthrough)
+{
+    TestResource resource(1024);
+    // Too large or too strictly aligned blocks go to operator new
+    void* large = resource.Allocate(129, 8);
+    void* aligned = resource.Allocate(16, 16);
+    BOOST_CHECK_EQUAL(resource.PooledBytes(), 0U);
+    BOOST_CHECK_EQUAL(resource.UnpooledBytes(), 145U);
+    BOOST_CHECK_EQUAL(resource.ChunkBytes(), 0U);
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(resource), memusage::MallocUsage(145));
+    resource.Deallocate(large, 129, 8);
+    resource.Deallocate(aligned, 16, 16);
+    BOOST_CHECK_EQUAL(resource.UnpooledBytes(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(pool_map)
+{
+    typedef std::map<int, int, std::less<int>, PoolAllocator<std::pair<const int, int>, 128, 8>> Map;
+    TestResource resource(1024);
+    {
+        Map m(std::less<int>(), &resource);
+        for (int i = 0; i < 1000; ++i) {
+            m[i] = i * 2;
+        }
+        BOOST_CHECK_EQUAL(m.size(), 1000U);
+        BOOST_CHECK(resource.PooledBytes() >= 1000 * sizeof(Map::value_type));
+        BOOST_CHECK_EQUAL(memusage::DynamicUsage(resource), resource.PooledBytes());
+        const size_t chunk_bytes = resource.ChunkBytes();
+
+        // Erasing and inserting as many nodes reuses their blocks
+        for (int i = 0; i < 500; ++i) {
+            m.erase(i);
+        }
+        for (int i = 1000; i < 1500; ++i) {
+            m[i] = i * 2;
+        }
+        BOOST_CHECK_EQUAL(resource.ChunkBytes(), chunk_bytes);
+        for (int i = 500; i < 1500; ++i) {
+            BOOST_CHECK_EQUAL(m.at(i), i * 2);
+        }
+
+        // Copies and moves share the resource
+        Map copy(m);
+        BOOST_CHECK(copy.get_allocator() == m.get_allocator());
+        Map moved(std::move(copy));
+        BOOST_CHECK_EQUAL(moved.size(), 1000U);
+    }
+    BOOST_CHECK_EQUAL(resource.PooledBytes(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
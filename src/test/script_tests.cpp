@@ -6,6 +6,7 @@
 
 #include <core_io.h>
 #include <key.h>
+#include <policy/policy.h>
 #include <script/script.h>
 #include <script/script_error.h>
 #include <script/sign.h>
@@ -16,6 +17,7 @@
 #include <test/util/setup_common.h>
 #include <rpc/util.h>
 #include <streams.h>
+#include <ticket.h>
 
 #if defined(HAVE_CONSENSUS_LIB)
 #include <script/bitcoinconsensus.h>
@@ -1487,6 +1489,97 @@ BOOST_AUTO_TEST_CASE(script_can_append_self)
     BOOST_CHECK(s == d);
 }
 
+static ScriptError VerifySpend(const CMutableTransaction& txSpend, const CMutableTransaction& txCredit, unsigned int flags)
+{
+    ScriptError err;
+    bool ret = VerifyScript(txSpend.vin[0].scriptSig, txCredit.vout[0].scriptPubKey, &txSpend.vin[0].scriptWitness, flags, MutableTransactionSignatureChecker(&txSpend, 0, txCredit.vout[0].nValue), &err);
+    BOOST_CHECK_EQUAL(ret, err == SCRIPT_ERR_OK);
+    return err;
+}
+
+static std::vector<unsigned char> SignSpend(const CKey& key, const CScript& scriptCode, const CMutableTransaction& txSpend, const CAmount amount, SigVersion sigversion)
+{
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(key.Sign(SignatureHash(scriptCode, txSpend, 0, SIGHASH_ALL, amount, sigversion), vchSig));
+    vchSig.push_back(static_cast<unsigned char>(SIGHASH_ALL));
+    return vchSig;
+}
+
+BOOST_AUTO_TEST_CASE(script_template_fast_path)
+{
+    const unsigned int flags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    CKey key, other_key;
+    key.MakeNewKey(true);
+    other_key.MakeNewKey(true);
+    const CPubKey pubkey = key.GetPubKey();
+
+    // P2PKH
+    {
+        const CScript scriptPubKey = GetScriptForDestination(PKHash(pubkey));
+        const CMutableTransaction txCredit = BuildCreditingTransaction(scriptPubKey, 1);
+        CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), CScriptWitness(), CTransaction(txCredit));
+        const std::vector<unsigned char> vchSig = SignSpend(key, scriptPubKey, txSpend, 1, SigVersion::BASE);
+        txSpend.vin[0].scriptSig = CScript() << vchSig << ToByteVector(pubkey);
+        BOOST_CHECK_EQUAL(VerifySpend(txSpend, txCredit, flags), SCRIPT_ERR_OK);
+
+        // Unexpected witness data is still rejected.
+        txSpend.vin[0].scriptWitness.stack.push_back({1});
+        BOOST_CHECK_EQUAL(VerifySpend(txSpend, txCredit, flags), SCRIPT_ERR_WITNESS_UNEXPECTED);
+        txSpend.vin[0].scriptWitness.SetNull();
+
+        // Extra pushes leave the stack unclean.
+        txSpend.vin[0].scriptSig = CScript() << OP_0 << vchSig << ToByteVector(pubkey);
+        BOOST_CHECK_EQUAL(VerifySpend(txSpend, txCredit, flags), SCRIPT_ERR_CLEANSTACK);
+
+        txSpend.vin[0].scriptSig = CScript() << vchSig << ToByteVector(other_key.GetPubKey());
+        BOOST_CHECK_EQUAL(VerifySpend(txSpend, txCredit, flags), SCRIPT_ERR_EQUALVERIFY);
+
+        txSpend.vin[0].scriptSig = CScript() << SignSpend(other_key, scriptPubKey, txSpend, 1, SigVersion::BASE) << ToByteVector(pubkey);
+        BOOST_CHECK_EQUAL(VerifySpend(txSpend, txCredit, flags), SCRIPT_ERR_SIG_NULLFAIL);
+        BOOST_CHECK_EQUAL(VerifySpend(txSpend, txCredit, flags & ~SCRIPT_VERIFY_NULLFAIL), SCRIPT_ERR_EVAL_FALSE);
+    }
+
+    // P2WPKH
+    {
+        const CScript scriptPubKey = GetScriptForDestination(WitnessV0KeyHash(pubkey.GetID()));
+        const CScript scriptCode = GetScriptForDestination(PKHash(pubkey));
+        const CMutableTransaction txCredit = BuildCreditingTransaction(scriptPubKey, 1);
+        CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), CScriptWitness(), CTransaction(txCredit));
+        txSpend.vin[0].scriptWitness.stack = {SignSpend(key, scriptCode, txSpend, 1, SigVersion::WITNESS_V0), ToByteVector(pubkey)};
+        BOOST_CHECK_EQUAL(VerifySpend(txSpend, txCredit, flags), SCRIPT_ERR_OK);
+
+        // The amount is committed to by the signature.
+        txSpend.vin[0].scriptWitness.stack[0] = SignSpend(key, scriptCode, txSpend, 2, SigVersion::WITNESS_V0);
+        BOOST_CHECK_EQUAL(VerifySpend(txSpend, txCredit, flags), SCRIPT_ERR_SIG_NULLFAIL);
+
+        txSpend.vin[0].scriptWitness.stack.pop_back();
+        BOOST_CHECK_EQUAL(VerifySpend(txSpend, txCredit, flags), SCRIPT_ERR_WITNESS_PROGRAM_MISMATCH);
+    }
+
+    // P2SH ticket
+    {
+        const int lockHeight = 2047;
+        const CScript redeemScript = GenerateTicketScript(pubkey.GetID(), lockHeight);
+        const CScript scriptPubKey = GetScriptForDestination(ScriptHash(redeemScript));
+        const CMutableTransaction txCredit = BuildCreditingTransaction(scriptPubKey, 1);
+        CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), CScriptWitness(), CTransaction(txCredit));
+        txSpend.nLockTime = lockHeight;
+        txSpend.vin[0].nSequence = CTxIn::SEQUENCE_FINAL - 1;
+        const std::vector<unsigned char> vchSig = SignSpend(key, redeemScript, txSpend, 1, SigVersion::BASE);
+        txSpend.vin[0].scriptSig = CScript() << vchSig << ToByteVector(pubkey) << ToByteVector(redeemScript);
+        BOOST_CHECK_EQUAL(VerifySpend(txSpend, txCredit, flags), SCRIPT_ERR_OK);
+
+        // Without CHECKLOCKTIMEVERIFY the interpreter treats it as a NOP.
+        txSpend.nLockTime = lockHeight - 1;
+        txSpend.vin[0].scriptSig = CScript() << SignSpend(key, redeemScript, txSpend, 1, SigVersion::BASE) << ToByteVector(pubkey) << ToByteVector(redeemScript);
+        BOOST_CHECK_EQUAL(VerifySpend(txSpend, txCredit, flags), SCRIPT_ERR_UNSATISFIED_LOCKTIME);
+        BOOST_CHECK_EQUAL(VerifySpend(txSpend, txCredit, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC), SCRIPT_ERR_OK);
+
+        const CScript otherRedeemScript = GenerateTicketScript(pubkey.GetID(), lockHeight + 1);
+        txSpend.vin[0].scriptSig = CScript() << vchSig << ToByteVector(pubkey) << ToByteVector(otherRedeemScript);
+        BOOST_CHECK_EQUAL(VerifySpend(txSpend, txCredit, flags), SCRIPT_ERR_EVAL_FALSE);
+    }
+}
 
 #if defined(HAVE_CONSENSUS_LIB)
 
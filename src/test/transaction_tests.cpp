@@ -281,6 +281,46 @@ BOOST_AUTO_TEST_CASE(basic_transaction_tests)
     BOOST_CHECK_MESSAGE(!CheckTransaction(CTransaction(tx), state) || !state.IsValid(), "Transaction with duplicate txins should be invalid.");
 }
 
+BOOST_AUTO_TEST_CASE(make_transaction_refs)
+{
+    // A mix of transactions with and without witnesses, of varying size.
+    std::vector<CMutableTransaction> txs(37);
+    for (size_t i = 0; i < txs.size(); ++i) {
+        txs[i].nLockTime = i;
+        txs[i].vin.resize(1 + i % 5);
+        for (size_t j = 0; j < txs[i].vin.size(); ++j) {
+            txs[i].vin[j].prevout = COutPoint(InsecureRand256(), j);
+            txs[i].vin[j].scriptSig = CScript() << std::vector<unsigned char>(i * 3 % 80, j);
+            if (i % 3 == 0) txs[i].vin[j].scriptWitness.stack.push_back(std::vector<unsigned char>(i, 1));
+        }
+        txs[i].vout.resize(1 + i % 2);
+    }
+
+    std::vector<CMutableTransaction> copy = txs;
+    const std::vector<CTransactionRef> refs = MakeTransactionRefs(std::move(copy));
+    BOOST_REQUIRE_EQUAL(refs.size(), txs.size());
+    for (size_t i = 0; i < txs.size(); ++i) {
+        const CTransaction tx(txs[i]);
+        BOOST_CHECK(tx.vin == refs[i]->vin);
+        BOOST_CHECK_EQUAL(tx.GetHash(), refs[i]->GetHash());
+        BOOST_CHECK_EQUAL(tx.GetWitnessHash(), refs[i]->GetWitnessHash());
+        BOOST_CHECK_EQUAL(refs[i]->HasWitness(), i % 3 == 0);
+    }
+
+    // Block deserialization goes through the batched path.
+    CBlock block;
+    for (const CMutableTransaction& tx : txs) block.vtx.push_back(MakeTransactionRef(tx));
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block;
+    CBlock block2;
+    stream >> block2;
+    BOOST_REQUIRE_EQUAL(block2.vtx.size(), block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        BOOST_CHECK_EQUAL(block.vtx[i]->GetHash(), block2.vtx[i]->GetHash());
+        BOOST_CHECK_EQUAL(block.vtx[i]->GetWitnessHash(), block2.vtx[i]->GetWitnessHash());
+    }
+}
+
 BOOST_AUTO_TEST_CASE(test_Get)
 {
     FillableSigningProvider keystore;
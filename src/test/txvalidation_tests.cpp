@@ -4,6 +4,7 @@
 
 #include <validation.h>
 #include <consensus/validation.h>
+#include <crypto/sha256.h>
 #include <primitives/transaction.h>
 #include <script/script.h>
 #include <test/util/setup_common.h>
@@ -52,4 +53,49 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_coinbase, TestChain100Setup)
     BOOST_CHECK(state.GetResult() == TxValidationResult::TX_CONSENSUS);
 }
 
+/**
+ * Ensure that a batch accepts transactions spending outputs of those before
+ * them, and rejects the others as AcceptToMemoryPool would.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_accept_batch, TestingSetup)
+{
+    const std::vector<unsigned char> op_true{OP_TRUE};
+    uint256 witness_program;
+    CSHA256().Write(&op_true[0], op_true.size()).Finalize(witness_program.begin());
+    const CScript script_pub = CScript(OP_0) << std::vector<unsigned char>{witness_program.begin(), witness_program.end()};
+
+    LOCK(cs_main);
+    CCoinsViewCache& coins_tip = ::ChainstateActive().CoinsTip();
+    const COutPoint funding(InsecureRand256(), 0);
+    coins_tip.AddCoin(funding, Coin(CTxOut(COIN, script_pub), 1, false), false);
+
+    auto make_spend = [&](const COutPoint& prevout, CAmount value) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(prevout);
+        tx.vin.back().scriptWitness.stack.push_back(op_true);
+        tx.vout.emplace_back(value, script_pub);
+        return MakeTransactionRef(tx);
+    };
+    const CTransactionRef parent = make_spend(funding, COIN - 10000);
+    const CTransactionRef child = make_spend(COutPoint(parent->GetHash(), 0), COIN - 20000);
+    // Spends an output that does not exist
+    const CTransactionRef orphan = make_spend(COutPoint(InsecureRand256(), 0), COIN);
+    // Spends the funding coin again, without the parent signalling replaceability
+    const CTransactionRef conflict = make_spend(funding, COIN - 50000);
+
+    std::vector<TxValidationState> states;
+    const size_t accepted = AcceptToMemoryPoolBatch(*m_node.mempool, {parent, child, orphan, conflict}, states, nullptr /* plTxnReplaced */, CFeeRate(0));
+    BOOST_CHECK_EQUAL(accepted, 2U);
+    BOOST_REQUIRE_EQUAL(states.size(), 4U);
+    BOOST_CHECK(states[0].IsValid());
+    BOOST_CHECK(states[1].IsValid());
+    BOOST_CHECK(states[2].GetResult() == TxValidationResult::TX_MISSING_INPUTS);
+    BOOST_CHECK_EQUAL(states[3].GetRejectReason(), "txn-mempool-conflict");
+    BOOST_CHECK(m_node.mempool->exists(child->GetHash()));
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 2U);
+
+    m_node.mempool->clear();
+    coins_tip.SpendCoin(funding);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
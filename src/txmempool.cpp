@@ -16,6 +16,7 @@
 #include <reverse_iterator.h>
 #include <util/system.h>
 #include <util/moneystr.h>
+#include <util/rbf.h>
 #include <util/time.h>
 #include <validationinterface.h>
 
@@ -23,7 +24,7 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFe
                                  int64_t _nTime, unsigned int _entryHeight,
                                  bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp)
     : tx(_tx), nFee(_nFee), nTxWeight(GetTransactionWeight(*tx)), nUsageSize(RecursiveDynamicUsage(tx)), nTime(_nTime), entryHeight(_entryHeight),
-    spendsCoinbase(_spendsCoinbase), sigOpCost(_sigOpsCost), lockPoints(lp), m_epoch(0)
+    spendsCoinbase(_spendsCoinbase), sigOpCost(_sigOpsCost), lockPoints(lp), m_epoch(0), m_cluster(0), m_cluster_pos(0)
 {
     nCountWithDescendants = 1;
     nSizeWithDescendants = GetTxSize();
@@ -60,13 +61,14 @@ size_t CTxMemPoolEntry::GetTxSize() const
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
     setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
+    const setLinks &setUpdateChildren = GetMemPoolChildren(updateIt);
+    stageEntries.insert(setUpdateChildren.begin(), setUpdateChildren.end());
 
     while (!stageEntries.empty()) {
         const txiter cit = *stageEntries.begin();
         setAllDescendants.insert(cit);
         stageEntries.erase(cit);
-        const setEntries &setChildren = GetMemPoolChildren(cit);
+        const setLinks &setChildren = GetMemPoolChildren(cit);
         for (txiter childEntry : setChildren) {
             cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
             if (cacheIt != cachedDescendants.end()) {
@@ -107,6 +109,7 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
 void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashesToUpdate)
 {
     AssertLockHeld(cs);
+    InvalidateSnapshot();
     // For each entry in vHashesToUpdate, store the set of in-mempool, but not
     // in-vHashesToUpdate transactions, so that we don't have to recalculate
     // descendants when we come across a previously seen entry.
@@ -172,7 +175,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        const setLinks &setParents = GetMemPoolParents(it);
+        parentHashes.insert(setParents.begin(), setParents.end());
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
@@ -195,7 +199,7 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
             return false;
         }
 
-        const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
+        const setLinks & setMemPoolParents = GetMemPoolParents(stageit);
         for (txiter phash : setMemPoolParents) {
             // If this is a new ancestor, add it.
             if (setAncestors.count(phash) == 0) {
@@ -213,7 +217,7 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
 
 void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors)
 {
-    setEntries parentIters = GetMemPoolParents(it);
+    const setLinks &parentIters = GetMemPoolParents(it);
     // add or remove this tx as a child of each parent
     for (txiter piter : parentIters) {
         UpdateChild(piter, it, add);
@@ -242,7 +246,7 @@ void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries &setAncesto
 
 void CTxMemPool::UpdateChildrenForRemoval(txiter it)
 {
-    const setEntries &setMemPoolChildren = GetMemPoolChildren(it);
+    const setLinks &setMemPoolChildren = GetMemPoolChildren(it);
     for (txiter updateIt : setMemPoolChildren) {
         UpdateParent(updateIt, it, false);
     }
@@ -327,7 +331,10 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator)
-    : nTransactionsUpdated(0), minerPolicyEstimator(estimator), m_epoch(0), m_has_epoch_guard(false)
+    : nTransactionsUpdated(0), minerPolicyEstimator(estimator), m_epoch(0), m_has_epoch_guard(false),
+      mapTx(indexed_transaction_set::ctor_args_list(), &m_node_resource),
+      mapLinks(CompareIteratorByHash(), &m_node_resource),
+      mapNextTx(&m_node_resource)
 {
     _clear(); //lock free clear
 
@@ -359,7 +366,8 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
     // Used by AcceptToMemoryPool(), which DOES do
     // all the appropriate checks.
     indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
-    mapLinks.insert(make_pair(newit, TxLinks()));
+    mapLinks.emplace(newit, TxLinks(&m_node_resource));
+    LogEvent(MempoolEvent::Type::ADDED, entry.GetTx().GetHash());
 
     // Update transaction for any feeDelta created by PrioritiseTransaction
     // TODO: refactor so that the fee delta is calculated before inserting
@@ -375,6 +383,10 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
     // further updated.)
     cachedInnerUsage += entry.DynamicMemoryUsage();
 
+    // The transaction starts out in a cluster of its own, which linking it to
+    // its parents below merges with theirs.
+    AddToCluster(NewCluster(), newit);
+
     const CTransaction& tx = newit->GetTx();
     std::set<uint256> setParentTransactions;
     for (unsigned int i = 0; i < tx.vin.size(); i++) {
@@ -412,6 +424,7 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
         // notification.
         GetMainSignals().TransactionRemovedFromMempool(it->GetSharedTx(), reason);
     }
+    LogEvent(MempoolEvent::Type::REMOVED, it->GetTx().GetHash(), reason);
 
     const uint256 hash = it->GetTx().GetHash();
     for (const CTxIn& txin : it->GetTx().vin)
@@ -426,9 +439,10 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     } else
         vTxHashes.clear();
 
+    RemoveFromCluster(it);
+
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
-    cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
     mapLinks.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
@@ -443,6 +457,11 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries& setDescendants) const
 {
+    if (m_clusters[entryit->m_cluster].members.size() == 1) {
+        // Alone in its cluster, so without any descendants
+        setDescendants.insert(entryit);
+        return;
+    }
     setEntries stage;
     if (setDescendants.count(entryit) == 0) {
         stage.insert(entryit);
@@ -455,7 +474,7 @@ void CTxMemPool::CalculateDescendants(txiter entryit, setEntries& setDescendants
         setDescendants.insert(it);
         stage.erase(it);
 
-        const setEntries &setChildren = GetMemPoolChildren(it);
+        const setLinks &setChildren = GetMemPoolChildren(it);
         for (txiter childiter : setChildren) {
             if (!setDescendants.count(childiter)) {
                 stage.insert(childiter);
@@ -565,6 +584,20 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
     }
     // Before the txs in the new block have been removed from the mempool, update policy estimates
     if (minerPolicyEstimator) {minerPolicyEstimator->processBlock(nBlockHeight, entries);}
+    // Clusters the block includes all of can go at once: no transaction left
+    // in the mempool has any of their members as ancestor or descendant, so
+    // there is no state to update.
+    std::map<size_t, size_t> mapClusterInBlock;
+    for (const CTxMemPoolEntry* entry : entries) {
+        ++mapClusterInBlock[entry->m_cluster];
+    }
+    for (const auto& cluster : mapClusterInBlock) {
+        if (cluster.second != m_clusters[cluster.first].members.size()) continue;
+        const std::vector<txiter> members = m_clusters[cluster.first].members;
+        for (txiter it : members) {
+            removeUnchecked(it, MemPoolRemovalReason::BLOCK);
+        }
+    }
     for (const auto& tx : vtx)
     {
         txiter it = mapTx.find(tx->GetHash());
@@ -582,7 +615,10 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
 
 void CTxMemPool::_clear()
 {
+    InvalidateSnapshot();
     mapLinks.clear();
+    m_clusters.clear();
+    m_free_clusters.clear();
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
@@ -634,7 +670,6 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         txlinksMap::const_iterator linksiter = mapLinks.find(it);
         assert(linksiter != mapLinks.end());
         const TxLinks &links = linksiter->second;
-        innerUsage += memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
         bool fDependsWait = false;
         setEntries setParentCheck;
         for (const CTxIn &txin : tx.vin) {
@@ -655,7 +690,15 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             assert(it3->second == &tx);
             i++;
         }
-        assert(setParentCheck == GetMemPoolParents(it));
+        assert(setParentCheck.size() == links.parents.size() && std::equal(setParentCheck.begin(), setParentCheck.end(), links.parents.begin()));
+        // Check the entry is in its cluster, along with its parents (and so
+        // with its children as well).
+        assert(it->m_cluster < m_clusters.size());
+        const Cluster& cluster = m_clusters[it->m_cluster];
+        assert(it->m_cluster_pos < cluster.members.size() && cluster.members[it->m_cluster_pos] == it);
+        for (txiter parentIt : setParentCheck) {
+            assert(parentIt->m_cluster == it->m_cluster);
+        }
         // Verify ancestor state is correct.
         setEntries setAncestors;
         uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -688,7 +731,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
                 child_sizes += childit->GetTxSize();
             }
         }
-        assert(setChildrenCheck == GetMemPoolChildren(it));
+        assert(setChildrenCheck.size() == links.children.size() && std::equal(setChildrenCheck.begin(), setChildrenCheck.end(), links.children.begin()));
         // Also check to make sure size is greater than sum with immediate children.
         // just a sanity check, not definitive that this calc is correct...
         assert(it->GetSizeWithDescendants() >= child_sizes + it->GetTxSize());
@@ -720,6 +763,42 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         assert(&tx == it->second);
     }
 
+    // Check cluster aggregates, and that every cluster is connected.
+    size_t nClusters = 0;
+    size_t nClusterMembers = 0;
+    for (const Cluster& cluster : m_clusters) {
+        if (cluster.members.empty()) continue;
+        ++nClusters;
+        nClusterMembers += cluster.members.size();
+        innerUsage += memusage::DynamicUsage(cluster.members);
+        uint64_t nSizeCheck = 0;
+        CAmount nFeesCheck = 0;
+        for (txiter member : cluster.members) {
+            nSizeCheck += member->GetTxSize();
+            nFeesCheck += member->GetModifiedFee();
+        }
+        assert(cluster.nSize == nSizeCheck);
+        assert(cluster.nModFees == nFeesCheck);
+
+        const auto epoch = GetFreshEpoch();
+        std::vector<txiter> stage{cluster.members.front()};
+        visited(stage.back());
+        size_t nReached = 0;
+        while (!stage.empty()) {
+            const TxLinks& links = mapLinks.find(stage.back())->second;
+            stage.pop_back();
+            ++nReached;
+            for (const setLinks* linked : {&links.parents, &links.children}) {
+                for (txiter linkedIt : *linked) {
+                    if (!visited(linkedIt)) stage.push_back(linkedIt);
+                }
+            }
+        }
+        assert(nReached == cluster.members.size());
+    }
+    assert(nClusters == GetClusterCount());
+    assert(nClusterMembers == mapTx.size());
+
     assert(totalTxSize == checkTotal);
     assert(innerUsage == cachedInnerUsage);
 }
@@ -786,6 +865,25 @@ static TxMempoolInfo GetInfo(CTxMemPool::indexed_transaction_set::const_iterator
     return TxMempoolInfo{it->GetSharedTx(), it->GetTime(), it->GetFee(), it->GetTxSize(), it->GetModifiedFee() - it->GetFee()};
 }
 
+std::vector<TxMempoolInfo> CTxMemPool::InfoForRelay(const std::vector<uint256>& hashes) const
+{
+    LOCK(cs);
+    std::vector<indexed_transaction_set::const_iterator> iters;
+    iters.reserve(hashes.size());
+    for (const uint256& hash : hashes) {
+        indexed_transaction_set::const_iterator i = mapTx.find(hash);
+        if (i != mapTx.end()) iters.push_back(i);
+    }
+    std::sort(iters.begin(), iters.end(), DepthAndScoreComparator());
+
+    std::vector<TxMempoolInfo> ret;
+    ret.reserve(iters.size());
+    for (auto it : iters) {
+        ret.push_back(GetInfo(it));
+    }
+    return ret;
+}
+
 std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
 {
     LOCK(cs);
@@ -800,6 +898,146 @@ std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
     return ret;
 }
 
+const MempoolSnapshot::Entry* MempoolSnapshot::Find(const uint256& txid) const
+{
+    auto it = std::lower_bound(entries.begin(), entries.end(), txid,
+        [](const Entry& entry, const uint256& hash) { return entry.txid < hash; });
+    if (it == entries.end() || it->txid != txid) return nullptr;
+    return &*it;
+}
+
+void CTxMemPool::InvalidateSnapshot()
+{
+    AssertLockHeld(cs);
+    ++m_snapshot_generation;
+    std::atomic_store(&m_snapshot, std::shared_ptr<const MempoolSnapshot>());
+}
+
+std::shared_ptr<const MempoolSnapshot> CTxMemPool::GetSnapshot() const
+{
+    std::shared_ptr<const MempoolSnapshot> snapshot = std::atomic_load(&m_snapshot);
+    if (snapshot) return snapshot;
+
+    auto fresh = std::make_shared<MempoolSnapshot>();
+    uint64_t generation;
+    {
+        LOCK(cs);
+        snapshot = std::atomic_load(&m_snapshot);
+        if (snapshot) return snapshot;
+        generation = m_snapshot_generation;
+        fresh->event_sequence = m_next_event_sequence;
+
+        fresh->entries.reserve(mapTx.size());
+        for (txiter it = mapTx.begin(); it != mapTx.end(); ++it) {
+            MempoolSnapshot::Entry entry;
+            const CTransaction& tx = it->GetTx();
+            entry.txid = tx.GetHash();
+            entry.wtxid = tx.GetWitnessHash();
+            entry.fee = it->GetFee();
+            entry.modified_fee = it->GetModifiedFee();
+            entry.vsize = it->GetTxSize();
+            entry.weight = it->GetTxWeight();
+            entry.time = it->GetTime();
+            entry.height = it->GetHeight();
+            entry.count_with_descendants = it->GetCountWithDescendants();
+            entry.size_with_descendants = it->GetSizeWithDescendants();
+            entry.mod_fees_with_descendants = it->GetModFeesWithDescendants();
+            entry.count_with_ancestors = it->GetCountWithAncestors();
+            entry.size_with_ancestors = it->GetSizeWithAncestors();
+            entry.mod_fees_with_ancestors = it->GetModFeesWithAncestors();
+            const TxLinks& links = mapLinks.find(it)->second;
+            entry.parents.reserve(links.parents.size());
+            for (txiter parent : links.parents) {
+                entry.parents.push_back(parent->GetTx().GetHash());
+            }
+            entry.children.reserve(links.children.size());
+            for (txiter child : links.children) {
+                entry.children.push_back(child->GetTx().GetHash());
+            }
+            // Only its own signalling for now, see below
+            entry.bip125_replaceable = SignalsOptInRBF(tx);
+            fresh->entries.push_back(std::move(entry));
+        }
+    }
+
+    std::sort(fresh->entries.begin(), fresh->entries.end(),
+        [](const MempoolSnapshot::Entry& a, const MempoolSnapshot::Entry& b) { return a.txid < b.txid; });
+
+    // A transaction is replaceable if one of its ancestors signals. A child
+    // has more ancestors than any of its parents, so going by ancestor count
+    // settles every parent before its children.
+    std::vector<MempoolSnapshot::Entry*> by_depth;
+    by_depth.reserve(fresh->entries.size());
+    for (MempoolSnapshot::Entry& entry : fresh->entries) {
+        if (!entry.parents.empty()) by_depth.push_back(&entry);
+    }
+    std::sort(by_depth.begin(), by_depth.end(),
+        [](const MempoolSnapshot::Entry* a, const MempoolSnapshot::Entry* b) { return a->count_with_ancestors < b->count_with_ancestors; });
+    for (MempoolSnapshot::Entry* entry : by_depth) {
+        for (const uint256& parent : entry->parents) {
+            if (entry->bip125_replaceable) break;
+            entry->bip125_replaceable = fresh->Find(parent)->bip125_replaceable;
+        }
+    }
+
+    snapshot = std::move(fresh);
+    LOCK(cs);
+    if (m_snapshot_generation == generation) std::atomic_store(&m_snapshot, snapshot);
+    return snapshot;
+}
+
+std::string RemovalReasonToString(MemPoolRemovalReason reason)
+{
+    switch (reason) {
+    case MemPoolRemovalReason::EXPIRY: return "expiry";
+    case MemPoolRemovalReason::SIZELIMIT: return "sizelimit";
+    case MemPoolRemovalReason::REORG: return "reorg";
+    case MemPoolRemovalReason::BLOCK: return "block";
+    case MemPoolRemovalReason::CONFLICT: return "conflict";
+    case MemPoolRemovalReason::REPLACED: return "replaced";
+    } // no default case, so the compiler can warn about missing cases
+    assert(false);
+}
+
+std::string MempoolEventTypeToString(MempoolEvent::Type type)
+{
+    switch (type) {
+    case MempoolEvent::Type::ADDED: return "added";
+    case MempoolEvent::Type::REMOVED: return "removed";
+    case MempoolEvent::Type::BLOCK_CONNECTED: return "blockconnected";
+    case MempoolEvent::Type::BLOCK_DISCONNECTED: return "blockdisconnected";
+    } // no default case, so the compiler can warn about missing cases
+    assert(false);
+}
+
+void CTxMemPool::LogEvent(MempoolEvent::Type type, const uint256& hash, Optional<MemPoolRemovalReason> reason)
+{
+    AssertLockHeld(cs);
+    InvalidateSnapshot();
+    const MempoolEvent event{m_next_event_sequence++, type, hash, reason};
+    m_events.push_back(event);
+    if (m_events.size() > MEMPOOL_EVENT_LOG_SIZE) m_events.pop_front();
+    // Queued while holding cs, so listeners get the events in order
+    GetMainSignals().MempoolEventLogged(event);
+}
+
+void CTxMemPool::LogBlockEvent(MempoolEvent::Type type, const uint256& block_hash)
+{
+    assert(type == MempoolEvent::Type::BLOCK_CONNECTED || type == MempoolEvent::Type::BLOCK_DISCONNECTED);
+    LOCK(cs);
+    LogEvent(type, block_hash);
+}
+
+std::vector<MempoolEvent> CTxMemPool::GetEvents(uint64_t start_sequence, bool& gap, uint64_t& next_sequence) const
+{
+    LOCK(cs);
+    next_sequence = m_next_event_sequence;
+    const uint64_t first_sequence = m_next_event_sequence - m_events.size();
+    gap = start_sequence < first_sequence;
+    if (start_sequence >= m_next_event_sequence) return {};
+    return std::vector<MempoolEvent>(m_events.begin() + (std::max(start_sequence, first_sequence) - first_sequence), m_events.end());
+}
+
 CTransactionRef CTxMemPool::get(const uint256& hash) const
 {
     LOCK(cs);
@@ -826,7 +1064,9 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
         delta += nFeeDelta;
         txiter it = mapTx.find(hash);
         if (it != mapTx.end()) {
+            InvalidateSnapshot();
             mapTx.modify(it, update_fee_delta(delta));
+            m_clusters[it->m_cluster].nModFees += nFeeDelta;
             // Now update all ancestors' modified fees with descendants
             setEntries setAncestors;
             uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -915,16 +1155,31 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
 
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
-    // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    // The nodes of mapTx, mapLinks and mapNextTx are all in m_node_resource
+    return memusage::DynamicUsage(m_node_resource) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(vTxHashes) + memusage::DynamicUsage(m_clusters) + memusage::DynamicUsage(m_free_clusters) + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
     AssertLockHeld(cs);
     UpdateForRemoveFromMempool(stage, updateDescendants);
+    // mapLinks now only links the staged transactions to those staying in the
+    // mempool. Taking away a single transaction linked to at most one of them
+    // (like the end of a chain) leaves its cluster connected; anything else
+    // may split it.
+    std::vector<size_t> vSplit;
     for (txiter it : stage) {
+        const TxLinks& links = mapLinks.find(it)->second;
+        const size_t nLinks = links.parents.size() + links.children.size();
+        if (nLinks > 1 || (nLinks == 1 && stage.size() > 1)) {
+            vSplit.push_back(it->m_cluster);
+        }
         removeUnchecked(it, reason);
     }
+    std::sort(vSplit.begin(), vSplit.end());
+    vSplit.erase(std::unique(vSplit.begin(), vSplit.end()), vSplit.end());
+    for (size_t cluster : vSplit) {
+        SplitCluster(cluster);
+    }
 }
 
 int CTxMemPool::Expire(std::chrono::seconds time)
@@ -953,27 +1208,140 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, bool validFeeEstimat
     return addUnchecked(entry, setAncestors, validFeeEstimate);
 }
 
+// The link sets allocate from m_node_resource, so their memory is not
+// counted in cachedInnerUsage.
 void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
 {
-    setEntries s;
-    if (add && mapLinks[entry].children.insert(child).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].children.erase(child)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    TxLinks& links = mapLinks.find(entry)->second;
+    if (add) {
+        links.children.insert(child);
+    } else {
+        links.children.erase(child);
     }
 }
 
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 {
-    setEntries s;
-    if (add && mapLinks[entry].parents.insert(parent).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].parents.erase(parent)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    TxLinks& links = mapLinks.find(entry)->second;
+    if (add) {
+        if (links.parents.insert(parent).second) MergeClusters(entry, parent);
+    } else {
+        links.parents.erase(parent);
+    }
+}
+
+size_t CTxMemPool::NewCluster()
+{
+    if (m_free_clusters.empty()) {
+        m_clusters.emplace_back();
+        return m_clusters.size() - 1;
+    }
+    const size_t cluster = m_free_clusters.back();
+    m_free_clusters.pop_back();
+    return cluster;
+}
+
+void CTxMemPool::AddToCluster(size_t cluster, txiter entry)
+{
+    Cluster& c = m_clusters[cluster];
+    cachedInnerUsage -= memusage::DynamicUsage(c.members);
+    entry->m_cluster = cluster;
+    entry->m_cluster_pos = c.members.size();
+    c.members.push_back(entry);
+    cachedInnerUsage += memusage::DynamicUsage(c.members);
+    c.nSize += entry->GetTxSize();
+    c.nModFees += entry->GetModifiedFee();
+}
+
+void CTxMemPool::RemoveFromCluster(txiter entry)
+{
+    Cluster& c = m_clusters[entry->m_cluster];
+    cachedInnerUsage -= memusage::DynamicUsage(c.members);
+    c.members[entry->m_cluster_pos] = c.members.back();
+    c.members[entry->m_cluster_pos]->m_cluster_pos = entry->m_cluster_pos;
+    c.members.pop_back();
+    c.nSize -= entry->GetTxSize();
+    c.nModFees -= entry->GetModifiedFee();
+    if (c.members.empty()) {
+        c = Cluster();
+        m_free_clusters.push_back(entry->m_cluster);
+    } else {
+        cachedInnerUsage += memusage::DynamicUsage(c.members);
+    }
+}
+
+void CTxMemPool::MergeClusters(txiter a, txiter b)
+{
+    size_t from = a->m_cluster;
+    size_t to = b->m_cluster;
+    if (from == to) return;
+    // Moving the smaller cluster means a transaction changes cluster at most
+    // log2(cluster size) times as clusters grow.
+    if (m_clusters[from].members.size() > m_clusters[to].members.size()) {
+        std::swap(from, to);
+    }
+    const std::vector<txiter> members = std::move(m_clusters[from].members);
+    cachedInnerUsage -= memusage::DynamicUsage(members);
+    m_clusters[from] = Cluster();
+    m_free_clusters.push_back(from);
+    for (txiter member : members) {
+        AddToCluster(to, member);
+    }
+}
+
+void CTxMemPool::SplitCluster(size_t cluster)
+{
+    if (m_clusters[cluster].members.empty()) return;
+    const std::vector<txiter> members = std::move(m_clusters[cluster].members);
+    cachedInnerUsage -= memusage::DynamicUsage(members);
+    m_clusters[cluster] = Cluster();
+
+    // Give each connected component its own cluster, the first one keeping
+    // the old cluster's index.
+    const auto epoch = GetFreshEpoch();
+    std::vector<txiter> stage;
+    bool first = true;
+    for (txiter root : members) {
+        if (visited(root)) continue;
+        const size_t component = first ? cluster : NewCluster();
+        first = false;
+        stage.push_back(root);
+        while (!stage.empty()) {
+            const txiter it = stage.back();
+            stage.pop_back();
+            AddToCluster(component, it);
+            const TxLinks& links = mapLinks.find(it)->second;
+            for (txiter parentIt : links.parents) {
+                if (!visited(parentIt)) stage.push_back(parentIt);
+            }
+            for (txiter childIt : links.children) {
+                if (!visited(childIt)) stage.push_back(childIt);
+            }
+        }
+    }
+}
+
+const CTxMemPool::Cluster& CTxMemPool::GetCluster(txiter entry) const
+{
+    assert(entry != mapTx.end());
+    return m_clusters[entry->m_cluster];
+}
+
+uint64_t CTxMemPool::GetClusterSizeWith(const setEntries& setAncestors) const
+{
+    // A transaction's ancestors are all in the clusters of its parents, so
+    // these are the clusters it would merge.
+    std::vector<size_t> vClusters;
+    uint64_t nSize = 1;
+    for (txiter ancestorIt : setAncestors) {
+        if (std::find(vClusters.begin(), vClusters.end(), ancestorIt->m_cluster) != vClusters.end()) continue;
+        vClusters.push_back(ancestorIt->m_cluster);
+        nSize += m_clusters[ancestorIt->m_cluster].members.size();
     }
+    return nSize;
 }
 
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
+const CTxMemPool::setLinks & CTxMemPool::GetMemPoolParents(txiter entry) const
 {
     assert (entry != mapTx.end());
     txlinksMap::const_iterator it = mapLinks.find(entry);
@@ -981,7 +1349,7 @@ const CTxMemPool::setEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
     return it->second.parents;
 }
 
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolChildren(txiter entry) const
+const CTxMemPool::setLinks & CTxMemPool::GetMemPoolChildren(txiter entry) const
 {
     assert (entry != mapTx.end());
     txlinksMap::const_iterator it = mapLinks.find(entry);
@@ -1074,7 +1442,7 @@ uint64_t CTxMemPool::CalculateDescendantMaximum(txiter entry) const {
         txiter candidate = candidates.back();
         candidates.pop_back();
         if (!counted.insert(candidate).second) continue;
-        const setEntries& parents = GetMemPoolParents(candidate);
+        const setLinks& parents = GetMemPoolParents(candidate);
         if (parents.size() == 0) {
             maximum = std::max(maximum, candidate->GetCountWithDescendants());
         } else {
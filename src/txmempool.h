@@ -7,7 +7,9 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <atomic>
+#include <deque>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <utility>
@@ -22,6 +24,7 @@
 #include <primitives/transaction.h>
 #include <sync.h>
 #include <random.h>
+#include <support/allocators/pool.h>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/hashed_index.hpp>
@@ -29,7 +32,7 @@
 #include <boost/multi_index/sequenced_index.hpp>
 
 class CBlockIndex;
-extern RecursiveMutex cs_main;
+extern HoldTimedRecursiveMutex cs_main;
 
 /** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
 static const uint32_t MEMPOOL_HEIGHT = 0x7FFFFFFF;
@@ -129,6 +132,8 @@ public:
 
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
     mutable uint64_t m_epoch; //!< epoch when last touched, useful for graph algorithms
+    mutable size_t m_cluster; //!< Index of the entry's cluster in mempool's m_clusters
+    mutable size_t m_cluster_pos; //!< Index in that cluster's members
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -342,6 +347,45 @@ struct TxMempoolInfo
     int64_t nFeeDelta;
 };
 
+/**
+ * Read-only copy of the mempool's entries at one point in time, see
+ * CTxMemPool::GetSnapshot(). Readers go through it without holding the
+ * mempool lock.
+ */
+struct MempoolSnapshot
+{
+    struct Entry {
+        uint256 txid;
+        uint256 wtxid;
+        CAmount fee;
+        CAmount modified_fee;
+        size_t vsize;
+        size_t weight;
+        std::chrono::seconds time;
+        unsigned int height;
+        uint64_t count_with_descendants;
+        uint64_t size_with_descendants;
+        CAmount mod_fees_with_descendants;
+        uint64_t count_with_ancestors;
+        uint64_t size_with_ancestors;
+        CAmount mod_fees_with_ancestors;
+        /** Txids of the in-mempool parents and children, in ascending order */
+        std::vector<uint256> parents;
+        std::vector<uint256> children;
+        /** Whether it or one of its in-mempool ancestors signals BIP125 replaceability */
+        bool bip125_replaceable;
+    };
+
+    /** Sorted by txid */
+    std::vector<Entry> entries;
+
+    /** Sequence number of the first event after the snapshot was taken */
+    uint64_t event_sequence{0};
+
+    /** The entry with this txid, or nullptr if there is none */
+    const Entry* Find(const uint256& txid) const;
+};
+
 /** Reason why a transaction was removed from the mempool,
  * this is passed to the notification signal.
  */
@@ -354,6 +398,36 @@ enum class MemPoolRemovalReason {
     REPLACED,    //!< Removed for replacement
 };
 
+std::string RemovalReasonToString(MemPoolRemovalReason reason);
+
+/** How many of the most recent events the mempool keeps, see CTxMemPool::GetEvents() */
+static const size_t MEMPOOL_EVENT_LOG_SIZE = 100000;
+
+/**
+ * A change to the mempool, or a block connected or disconnected while the
+ * mempool was updated for it. Events are numbered without gaps, so replaying
+ * them from a snapshot (see MempoolSnapshot::event_sequence) keeps a copy of
+ * the mempool in sync.
+ */
+struct MempoolEvent
+{
+    enum class Type {
+        ADDED,
+        REMOVED,
+        BLOCK_CONNECTED,
+        BLOCK_DISCONNECTED,
+    };
+
+    uint64_t sequence;
+    Type type;
+    /** The txid, or the block hash for the block events */
+    uint256 hash;
+    /** Why the transaction was removed, for REMOVED only */
+    Optional<MemPoolRemovalReason> reason;
+};
+
+std::string MempoolEventTypeToString(MempoolEvent::Type type);
+
 class SaltedTxidHasher
 {
 private:
@@ -442,7 +516,17 @@ public:
  */
 class CTxMemPool
 {
+public:
+    /** The node based containers of the mempool (mapTx, mapLinks and the link
+     *  sets in it, mapNextTx) allocate from one pool, rather than paying
+     *  malloc's overhead on every entry, link and spent outpoint. Blocks are
+     *  large enough for a mapTx node. */
+    typedef PoolResource<512, alignof(void*)> NodeResource;
+    template <typename T>
+    using NodeAllocator = PoolAllocator<T, 512, alignof(void*)>;
+
 private:
+    NodeResource m_node_resource;
     uint32_t nCheckFrequency GUARDED_BY(cs); //!< Value n means that n times in 2^32 we check.
     std::atomic<unsigned int> nTransactionsUpdated; //!< Used by getblocktemplate to trigger CreateNewBlock() invocation
     CBlockPolicyEstimator* minerPolicyEstimator;
@@ -460,6 +544,19 @@ private:
 
     bool m_is_loaded GUARDED_BY(cs){false};
 
+    /** Latest snapshot, or null if the mempool changed since it was taken.
+     *  Only accessed through std::atomic_load and std::atomic_store. */
+    mutable std::shared_ptr<const MempoolSnapshot> m_snapshot;
+    /** Bumped on every change, so a snapshot taken before one is not published */
+    uint64_t m_snapshot_generation GUARDED_BY(cs){0};
+
+    void InvalidateSnapshot() EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    std::deque<MempoolEvent> m_events GUARDED_BY(cs);
+    uint64_t m_next_event_sequence GUARDED_BY(cs){0};
+
+    void LogEvent(MempoolEvent::Type type, const uint256& hash, Optional<MemPoolRemovalReason> reason = nullopt) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
 public:
 
     static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
@@ -487,7 +584,8 @@ public:
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByAncestorFee
             >
-        >
+        >,
+        NodeAllocator<CTxMemPoolEntry>
     > indexed_transaction_set;
 
     /**
@@ -529,28 +627,59 @@ public:
         }
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
+    /** The in-mempool direct parents or children of an entry */
+    typedef std::set<txiter, CompareIteratorByHash, NodeAllocator<txiter>> setLinks;
 
-    const setEntries & GetMemPoolParents(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
-    const setEntries & GetMemPoolChildren(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    const setLinks & GetMemPoolParents(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    const setLinks & GetMemPoolChildren(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
     uint64_t CalculateDescendantMaximum(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /** A connected component of the graph of in-mempool parent/child links:
+     *  all in-mempool ancestors and descendants of a member are members too.
+     *  Clusters are merged when a transaction links two of them and split when
+     *  a removal disconnects one, so no walk over ancestors or descendants ever
+     *  leaves the cluster it started in. Members are in no particular order. */
+    struct Cluster {
+        std::vector<txiter> members;
+        uint64_t nSize{0};   //!< Total virtual size of the members
+        CAmount nModFees{0}; //!< Total modified fees of the members
+    };
+    const Cluster& GetCluster(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    size_t GetClusterCount() const EXCLUSIVE_LOCKS_REQUIRED(cs) { return m_clusters.size() - m_free_clusters.size(); }
+    /** Number of transactions in the cluster a new transaction with these
+     *  in-mempool ancestors would be in, including itself. */
+    uint64_t GetClusterSizeWith(const setEntries& setAncestors) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 private:
     typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
     struct TxLinks {
-        setEntries parents;
-        setEntries children;
+        explicit TxLinks(const NodeAllocator<txiter>& alloc) : parents(CompareIteratorByHash(), alloc), children(CompareIteratorByHash(), alloc) {}
+        setLinks parents;
+        setLinks children;
     };
 
-    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
+    typedef std::map<txiter, TxLinks, CompareIteratorByHash, NodeAllocator<std::pair<const txiter, TxLinks>>> txlinksMap;
     txlinksMap mapLinks;
 
+    std::vector<Cluster> m_clusters;
+    std::vector<size_t> m_free_clusters; //!< Indexes of unused entries in m_clusters
+
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
+    /** Index of an unused, empty cluster */
+    size_t NewCluster();
+    void AddToCluster(size_t cluster, txiter entry);
+    void RemoveFromCluster(txiter entry);
+    /** Move the members of the smaller of the clusters of a and b to the larger one */
+    void MergeClusters(txiter a, txiter b);
+    /** Repartition the remaining members of a cluster into connected clusters */
+    void SplitCluster(size_t cluster);
+
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
 public:
-    indirectmap<COutPoint, const CTransaction*> mapNextTx GUARDED_BY(cs);
+    indirectmap<COutPoint, const CTransaction*, NodeAllocator<std::pair<const COutPoint* const, const CTransaction*>>> mapNextTx GUARDED_BY(cs);
     std::map<uint256, CAmount> mapDeltas;
 
     /** Create a new CTxMemPool.
@@ -695,6 +824,30 @@ public:
     CTransactionRef get(const uint256& hash) const;
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
+    /** Info for those of hashes that are in the mempool, in the order to relay
+     *  them in: parents before children, then by descending score. Takes the
+     *  mempool lock once, rather than once per comparison as sorting with
+     *  CompareDepthAndScore() does. */
+    std::vector<TxMempoolInfo> InfoForRelay(const std::vector<uint256>& hashes) const;
+
+    /**
+     * A read-only copy of all entries. It is shared by all callers until the
+     * mempool next changes, and the first call after a change takes the
+     * mempool lock only for as long as copying the entries takes, so readers
+     * like RPC don't hold up transaction acceptance while they go through it.
+     */
+    std::shared_ptr<const MempoolSnapshot> GetSnapshot() const;
+
+    /** Log a block connected or disconnected, after the mempool was updated for it */
+    void LogBlockEvent(MempoolEvent::Type type, const uint256& block_hash) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /**
+     * The logged events from start_sequence on. Sets gap if some of them have
+     * been dropped from the log already, after which a consumer has to start
+     * over from a snapshot. next_sequence is set to the sequence number the
+     * next event will get.
+     */
+    std::vector<MempoolEvent> GetEvents(uint64_t start_sequence, bool& gap, uint64_t& next_sequence) const;
 
     size_t DynamicMemoryUsage() const;
 
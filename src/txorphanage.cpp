@@ -0,0 +1,221 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txorphanage.h>
+
+#include <consensus/validation.h>
+#include <core_memusage.h>
+#include <logging.h>
+#include <policy/policy.h>
+#include <random.h>
+#include <util/time.h>
+
+#include <algorithm>
+#include <cassert>
+
+RecursiveMutex g_cs_orphans;
+
+bool TxOrphanage::AddTx(const CTransactionRef& tx, NodeId peer)
+{
+    AssertLockHeld(g_cs_orphans);
+
+    const uint256& hash = tx->GetHash();
+    if (m_orphans.count(hash))
+        return false;
+
+    // Ignore big transactions, to avoid a
+    // send-big-orphans memory exhaustion attack. If a peer has a legitimate
+    // large transaction with a missing parent then we assume
+    // it will rebroadcast it later, after the parent transaction(s)
+    // have been mined or received.
+    // 100 orphans, each of which is at most 100,000 bytes big is
+    // at most 10 megabytes of orphans and somewhat more byprev index (in the worst case):
+    unsigned int sz = GetTransactionWeight(*tx);
+    if (sz > MAX_STANDARD_TX_WEIGHT)
+    {
+        LogPrint(BCLog::MEMPOOL, "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
+        return false;
+    }
+
+    PeerOrphans& peer_orphans = m_peer_orphans[peer];
+    const size_t bytes = RecursiveDynamicUsage(tx);
+    auto ret = m_orphans.emplace(hash, OrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, bytes, peer_orphans.orphans.size()});
+    assert(ret.second);
+    OrphanRef orphan = &*ret.first;
+    peer_orphans.orphans.push_back(orphan);
+    peer_orphans.bytes += bytes;
+    m_total_bytes += bytes;
+    for (const CTxIn& txin : tx->vin) {
+        std::vector<OrphanRef>& spenders = m_outpoint_to_orphan[txin.prevout];
+        // A transaction spending the same outpoint twice is invalid, but
+        // still may not leave a dangling entry behind when erased.
+        if (std::find(spenders.begin(), spenders.end(), orphan) == spenders.end()) {
+            spenders.push_back(orphan);
+        }
+    }
+
+    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u bytes %u)\n", hash.ToString(),
+             m_orphans.size(), m_outpoint_to_orphan.size(), m_total_bytes);
+    return true;
+}
+
+bool TxOrphanage::HaveTx(const uint256& txid) const
+{
+    AssertLockHeld(g_cs_orphans);
+    return m_orphans.count(txid);
+}
+
+CTransactionRef TxOrphanage::GetTx(const uint256& txid, NodeId& from_peer) const
+{
+    AssertLockHeld(g_cs_orphans);
+    const auto it = m_orphans.find(txid);
+    if (it == m_orphans.end()) return nullptr;
+    from_peer = it->second.fromPeer;
+    return it->second.tx;
+}
+
+void TxOrphanage::EraseOrphan(OrphanRef orphan)
+{
+    OrphanTx& entry = orphan->second;
+    for (const CTxIn& txin : entry.tx->vin) {
+        auto it_prev = m_outpoint_to_orphan.find(txin.prevout);
+        if (it_prev == m_outpoint_to_orphan.end())
+            continue;
+        std::vector<OrphanRef>& spenders = it_prev->second;
+        spenders.erase(std::remove(spenders.begin(), spenders.end(), orphan), spenders.end());
+        if (spenders.empty())
+            m_outpoint_to_orphan.erase(it_prev);
+    }
+
+    auto it_peer = m_peer_orphans.find(entry.fromPeer);
+    assert(it_peer != m_peer_orphans.end());
+    PeerOrphans& peer_orphans = it_peer->second;
+    std::vector<OrphanRef>& peer_list = peer_orphans.orphans;
+    assert(peer_list[entry.peer_pos] == orphan);
+    if (entry.peer_pos + 1 != peer_list.size()) {
+        // Unless we're deleting the peer's last orphan, move the last
+        // orphan to the position we're deleting.
+        peer_list[entry.peer_pos] = peer_list.back();
+        peer_list[entry.peer_pos]->second.peer_pos = entry.peer_pos;
+    }
+    peer_list.pop_back();
+    peer_orphans.bytes -= entry.bytes;
+    if (peer_orphans.orphans.empty()) {
+        m_peer_orphans.erase(it_peer);
+    }
+
+    m_total_bytes -= entry.bytes;
+    m_orphans.erase(m_orphans.find(orphan->first));
+}
+
+int TxOrphanage::EraseTx(const uint256& txid)
+{
+    AssertLockHeld(g_cs_orphans);
+    auto it = m_orphans.find(txid);
+    if (it == m_orphans.end())
+        return 0;
+    EraseOrphan(&*it);
+    return 1;
+}
+
+void TxOrphanage::EraseForPeer(NodeId peer)
+{
+    AssertLockHeld(g_cs_orphans);
+    auto it_peer = m_peer_orphans.find(peer);
+    if (it_peer == m_peer_orphans.end()) return;
+
+    // Erasing the peer's last orphan erases its entry as well.
+    int nErased = it_peer->second.orphans.size();
+    while (m_peer_orphans.count(peer)) {
+        EraseOrphan(m_peer_orphans[peer].orphans.back());
+    }
+    LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer=%d\n", nErased, peer);
+}
+
+void TxOrphanage::EraseForBlock(const CBlock& block)
+{
+    AssertLockHeld(g_cs_orphans);
+
+    std::vector<uint256> vOrphanErase;
+
+    for (const CTransactionRef& ptx : block.vtx) {
+        const CTransaction& tx = *ptx;
+
+        // Which orphan pool entries must we evict?
+        for (const auto& txin : tx.vin) {
+            auto itByPrev = m_outpoint_to_orphan.find(txin.prevout);
+            if (itByPrev == m_outpoint_to_orphan.end()) continue;
+            for (const OrphanRef orphan : itByPrev->second) {
+                vOrphanErase.push_back(orphan->first);
+            }
+        }
+    }
+
+    // Erase orphan transactions included or precluded by this block
+    if (vOrphanErase.size()) {
+        int nErased = 0;
+        for (const uint256& orphanHash : vOrphanErase) {
+            nErased += EraseTx(orphanHash);
+        }
+        LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx included or conflicted by block\n", nErased);
+    }
+}
+
+unsigned int TxOrphanage::LimitOrphans(unsigned int max_orphans, size_t max_bytes)
+{
+    AssertLockHeld(g_cs_orphans);
+
+    unsigned int nEvicted = 0;
+    int64_t nNow = GetTime();
+    if (m_next_sweep <= nNow) {
+        // Sweep out expired orphan pool entries:
+        int nErased = 0;
+        int64_t nMinExpTime = nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
+        auto iter = m_orphans.begin();
+        while (iter != m_orphans.end())
+        {
+            auto maybeErase = iter++;
+            if (maybeErase->second.nTimeExpire <= nNow) {
+                EraseOrphan(&*maybeErase);
+                ++nErased;
+            } else {
+                nMinExpTime = std::min(maybeErase->second.nTimeExpire, nMinExpTime);
+            }
+        }
+        // Sweep again 5 minutes after the next entry that expires in order to batch the linear scan.
+        m_next_sweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
+        if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n", nErased);
+    }
+    FastRandomContext rng;
+    while (m_orphans.size() > max_orphans || m_total_bytes > max_bytes)
+    {
+        // Evict a random orphan of the peer using the most memory:
+        auto it_peer = std::max_element(m_peer_orphans.begin(), m_peer_orphans.end(),
+            [](const std::pair<const NodeId, PeerOrphans>& a, const std::pair<const NodeId, PeerOrphans>& b) { return a.second.bytes < b.second.bytes; });
+        const std::vector<OrphanRef>& orphans = it_peer->second.orphans;
+        EraseOrphan(orphans[rng.randrange(orphans.size())]);
+        ++nEvicted;
+    }
+    return nEvicted;
+}
+
+void TxOrphanage::AddChildrenToWorkSet(const CTransaction& tx, std::set<uint256>& work_set) const
+{
+    AssertLockHeld(g_cs_orphans);
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        const auto it_by_prev = m_outpoint_to_orphan.find(COutPoint(tx.GetHash(), i));
+        if (it_by_prev != m_outpoint_to_orphan.end()) {
+            for (const OrphanRef orphan : it_by_prev->second) {
+                work_set.insert(orphan->first);
+            }
+        }
+    }
+}
+
+size_t TxOrphanage::PeerBytes(NodeId peer) const
+{
+    AssertLockHeld(g_cs_orphans);
+    const auto it = m_peer_orphans.find(peer);
+    return it == m_peer_orphans.end() ? 0 : it->second.bytes;
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXORPHANAGE_H
+#define BITCOIN_TXORPHANAGE_H
+
+#include <coins.h>
+#include <net.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <sync.h>
+#include <txmempool.h>
+
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+/** Guards orphan transactions and extra txs for compact blocks */
+extern RecursiveMutex g_cs_orphans;
+
+/** Expiration time for orphan transactions in seconds */
+static constexpr int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+/** Minimum time between orphan transactions expire time checks in seconds */
+static constexpr int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+
+/**
+ * Transactions we received whose inputs we could not find (TX_MISSING_INPUTS).
+ * Since we cannot tell orphans from transactions with bogus inputs, how many of
+ * them we keep and for how long is heavily limited, in count and in memory.
+ * When over a limit, orphans are evicted from the peer that uses the most
+ * memory, so a single peer flooding us can not push out everyone else's.
+ *
+ * Orphans are indexed by txid and by the outpoints they spend in hash tables
+ * whose entries point to each other, so no lookup goes through a tree.
+ */
+class TxOrphanage
+{
+public:
+    /** Add an orphan received from peer. Returns false if it was not added,
+     *  because we already have it or it is too big. */
+    bool AddTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    bool HaveTx(const uint256& txid) const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** The orphan with this txid and the peer it came from, or nullptr. */
+    CTransactionRef GetTx(const uint256& txid, NodeId& from_peer) const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** Erase an orphan by txid. Returns the number of orphans erased (0 or 1). */
+    int EraseTx(const uint256& txid) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** Erase all orphans received from peer */
+    void EraseForPeer(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** Erase all orphans included in or conflicting with a block */
+    void EraseForBlock(const CBlock& block) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** Erase expired orphans, then evict until at most max_orphans orphans
+     *  using at most max_bytes of memory remain. Returns the number evicted
+     *  for being over a limit. */
+    unsigned int LimitOrphans(unsigned int max_orphans, size_t max_bytes) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** Add the txids of all orphans spending an output of tx to work_set */
+    void AddChildrenToWorkSet(const CTransaction& tx, std::set<uint256>& work_set) const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    size_t Size() const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans) { return m_orphans.size(); }
+    /** Memory used by the orphans themselves */
+    size_t TotalBytes() const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans) { return m_total_bytes; }
+    /** Memory used by the orphans received from peer */
+    size_t PeerBytes(NodeId peer) const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+protected:
+    struct OrphanTx {
+        CTransactionRef tx;
+        NodeId fromPeer;
+        int64_t nTimeExpire;
+        size_t bytes;
+        /** Position in the peer's PeerOrphans::orphans */
+        size_t peer_pos;
+    };
+    typedef std::unordered_map<uint256, OrphanTx, SaltedTxidHasher> OrphanMap;
+    /** Entries of m_orphans stay where they are when it rehashes, unlike its
+     *  iterators, so the indexes below refer to them by pointer. */
+    typedef OrphanMap::value_type* OrphanRef;
+
+    struct PeerOrphans {
+        std::vector<OrphanRef> orphans;
+        size_t bytes{0};
+    };
+
+    OrphanMap m_orphans GUARDED_BY(g_cs_orphans);
+    /** The orphans spending each outpoint */
+    std::unordered_map<COutPoint, std::vector<OrphanRef>, SaltedOutpointHasher> m_outpoint_to_orphan GUARDED_BY(g_cs_orphans);
+    /** The orphans of each peer that has some */
+    std::unordered_map<NodeId, PeerOrphans> m_peer_orphans GUARDED_BY(g_cs_orphans);
+    size_t m_total_bytes GUARDED_BY(g_cs_orphans){0};
+    int64_t m_next_sweep GUARDED_BY(g_cs_orphans){0};
+
+    void EraseOrphan(OrphanRef orphan) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+};
+
+#endif // BITCOIN_TXORPHANAGE_H